@@ -21,4 +21,3 @@
 # tests/perf/pch.h
 # tests/perf/perftest.cpp
 # tests/repro/main.cpp
-# vendor/gh-pages
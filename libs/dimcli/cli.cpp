@@ -13,14 +13,48 @@
 
 #include <algorithm>
 #include <atomic>
+#include <climits>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <list>
 #include <locale>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+// SSE2 is available on all x64 targets, and on x86 when enabled.
+#if defined(__SSE2__) || defined(_M_X64) \
+    || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#define DIMCLI_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// POSIX memory mapped files, used to load large response files.
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+#define DIMCLI_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
 
 using namespace std;
+using namespace std::chrono;
 using namespace Dim;
 #ifdef DIMCLI_LIB_FILESYSTEM
 namespace fs = DIMCLI_LIB_FILESYSTEM;
@@ -49,6 +83,17 @@ const auto kDefaultMaxKeyWidth = 38.0f;
 // maximum help text line length
 const size_t kDefaultMaxLineWidth = kDefaultConsoleWidth - 1;
 
+// smallest block of memory allocated by the per parse arena
+const size_t kMinArenaBlockSize = 4096;
+
+// most seeds tried for a bucket of long names before giving up on a perfect
+// hash of them and searching a sorted list instead
+const unsigned kMaxLongNameSeeds = 10'000;
+
+// smallest response file that is memory mapped instead of read, if mapping
+// is available
+const size_t kMinMappedFileSize = 64 * 1024;
+
 
 /****************************************************************************
 *
@@ -82,7 +127,7 @@ struct OptName {
     Cli::OptBase * opt;
     bool invert;    // set to false instead of true (only for bools)
     bool optional;  // value need not be present? (non-bools only)
-    string name;    // name of argument (only for operands)
+    string name;    // name of operand, or option name with leading dashes
     int pos;        // used to sort an option's names in declaration order
 };
 
@@ -108,14 +153,14 @@ struct CodecvtWchar : codecvt<wchar_t, char, mbstate_t> {
 struct RawValue {
     enum Type { kOperand, kOption, kCommand } type;
     Cli::OptBase * opt;
-    string name;
+    const string * name;    // refers to OptName::name of the index
     size_t pos;
-    const char * ptr;
+    const char * ptr;       // refers to the args being parsed
 
     RawValue(
         Type type,
         Cli::OptBase * opt,
-        string name,
+        const string * name,
         size_t pos = 0,
         const char * ptr = nullptr
     )
@@ -127,14 +172,65 @@ struct RawValue {
     {}
 };
 
+// Monotonic allocator for state that only lives for the duration of a
+// parse. Memory is never freed individually, instead the whole arena is
+// reset when the next parse starts, and the blocks are kept for reuse.
+class Arena {
+public:
+    void * allocate(size_t bytes, size_t align);
+    void reset();
+    void addFootprint(Cli::Footprint & out) const;
+
+private:
+    struct Block {
+        unique_ptr<char[]> data;
+        size_t size;
+    };
+    vector<Block> m_blocks;
+    size_t m_block {0};     // block currently being allocated from
+    size_t m_used {0};      // bytes used in the current block
+};
+
+template <typename T>
+struct ArenaAlloc {
+    using value_type = T;
+
+    Arena * arena;
+
+    ArenaAlloc(Arena & arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAlloc(const ArenaAlloc<U> & from) : arena(from.arena) {}
+
+    T * allocate(size_t num) {
+        return static_cast<T *>(arena->allocate(num * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAlloc<U> & other) const {
+        return arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAlloc<U> & other) const {
+        return arena != other.arena;
+    }
+};
+
+template <typename T>
+using ArenaVec = vector<T, ArenaAlloc<T>>;
+
 } // namespace
 
 struct Cli::OptIndex {
-    unordered_map<char, OptName> m_shortNames;
-    unordered_map<string, OptName> m_longNames;
+    // Option names in declaration order.
+    vector<pair<char, OptName>> m_shortNames;
+    vector<pair<string, OptName>> m_longNames;
     vector<OptName> m_argNames;
     bool m_allowCommands {};
 
+    // Definition version of the config at the time this index was built.
+    unsigned m_version {};
+
     enum class Final {
         // In order of priority
         kUnset,     // nothing interesting found
@@ -152,6 +248,8 @@ struct Cli::OptIndex {
         bool requireVisible
     );
     void index(OptBase & opt);
+    const OptName * findShort(char name) const;
+    const OptName * findLong(const char name[], size_t len) const;
     vector<OptKey> findNamedOpts(
         const Cli & cli,
         CommandConfig & cmd,
@@ -164,6 +262,8 @@ struct Cli::OptIndex {
         NameListType type
     ) const;
 
+    void addFootprint(Footprint & out) const;
+
     static string desc(const OptBase & opt, bool withMarkup = true);
     static const unordered_map<string, OptBase::ChoiceDesc> & choiceDescs(
         const OptBase & opt
@@ -185,6 +285,53 @@ private:
         bool optional,
         int pos
     );
+    void freezeLongNames();
+    void sortLongNames();
+
+    // Position in m_shortNames plus one, indexed by character, or zero if
+    // the character isn't a short name.
+    unsigned short m_shortTable[256] {};
+
+    // Minimal perfect hash of m_longNames, built by freezeLongNames. The
+    // bucket of a name selects a seed which, when hashed with the name,
+    // gives its slot. Negative seeds are single name buckets where the slot
+    // is stored directly as -(slot + 1).
+    vector<int> m_longSeeds;
+    vector<unsigned> m_longSlots;
+
+    // Positions in m_longNames sorted by name, only used when no perfect
+    // hash was found.
+    vector<unsigned> m_longSorted;
+};
+
+struct Cli::Context::State {
+    // Config this context was last parsed with, and the value proxies of
+    // its options indexed by OptBase::m_slot. Proxies are created the first
+    // time they're used, see proxy().
+    const Config * cfg {};
+    vector<shared_ptr<void>> proxies;
+
+    int exitCode {kExitOk};
+    string errMsg;
+    string errDetail;
+    string progName;
+    string command;
+    vector<string> unknownArgs;
+
+    // Scratch memory for the parse in progress.
+    Arena arena;
+
+    // Phase timing, phase is kPhases when no phase is being timed.
+    vector<PhaseEvent> phaseEvents;
+    Phase phase {kPhases};
+    const OptBase * phaseOpt {};
+    steady_clock::time_point phaseStart;
+
+    // Args of the parse in progress when they were passed by rvalue, so
+    // string values can be moved out of them.
+    vector<string> * ownedArgs {};
+
+    void * proxy(const OptBase & opt);
 };
 
 struct Cli::Config {
@@ -193,28 +340,62 @@ struct Cli::Config {
     function<ActionFn> unknownCmd;
     unordered_map<string, CommandConfig> cmds;
     unordered_map<string, GroupConfig> cmdGroups;
-    list<unique_ptr<OptBase>> opts;
+
+    // Memory of the options and their value proxies, declared before the
+    // options so that it outlives them.
+    Arena slab;
+    vector<OptBase *> opts;
+
+    // First option added for each value address, so options of the same
+    // value can share its proxy without searching all the options.
+    unordered_map<const void *, OptBase *> optsByValue;
     bool responseFiles {true};
+    shared_ptr<ResponseFileCache> rspCache;
+    unsigned responseFileThreads {1};
     string envOpts;
     istream * conin {&cin};
     ostream * conout {&cout};
-    shared_ptr<locale> defLoc = make_shared<locale>();
-    shared_ptr<locale> numLoc = make_shared<locale>("");
 
-    int exitCode {kExitOk};
-    string errMsg;
-    string errDetail;
-    string progName;
-    string command;
-    vector<string> unknownArgs;
+    // Results of parses not made into an explicit context.
+    Context context;
 
     size_t maxWidth {kDefaultConsoleWidth};
     float minKeyWidth {kDefaultMinKeyWidth};
     float maxKeyWidth {kDefaultMaxKeyWidth};
     size_t maxLineWidth {kDefaultMaxLineWidth};
 
+    // Incremented whenever options or commands are added or an option is
+    // modified in a way that changes how it's indexed. Cached indexes built
+    // for an older version are rebuilt before they're used.
+    unsigned defVersion {1};
+    unsigned touchVersion {};
+    unordered_map<string, OptIndex> ndxs;
+
+    // Set by cli.freeze(), after which the definition and indexes are only
+    // read, and the number of distinct values (and therefore proxies) of
+    // the options.
+    bool frozen {false};
+    size_t numSlots {0};
+
+    bool phaseTiming {false};
+
+    // Set by cli.lazyReset(), takes effect (lazyActive) with the next
+    // parse, after which each parse increments the generation and only the
+    // options bound to external variables are reset immediately.
+    bool lazyReset {false};
+    bool lazyActive {false};
+    unsigned generation {1};
+    vector<OptBase *> boundOpts;
+
     static void touchAllCmds(Cli & cli);
+    static const OptIndex & findIndex(Cli & cli, const string & cmd);
     static Config & get(Cli & cli);
+    static Context::State & state(const Cli & cli);
+    static void bind(Cli & cli, Context & ctx);
+    static void makeClone(Cli & clone);
+    static Context * cloneContext(const Cli & cli);
+    static Context * pendingContext(const Cli & cli);
+    static ResponseFileCache::State * responseFileCache(Cli & cli);
     static CommandConfig & findCmdAlways(Cli & cli);
     static CommandConfig & findCmdAlways(Cli & cli, const string & name);
     static const CommandConfig & findCmdOrDie(const Cli & cli);
@@ -231,9 +412,13 @@ struct Cli::Config {
     static const GroupConfig & findGrpOrDie(const Cli & cli);
 
     Config();
+    ~Config();
     void updateWidth(size_t width);
 };
 
+// Context made active on this thread by the innermost Context::Scope.
+static thread_local Cli::Context * t_context;
+
 
 #ifdef DIMCLI_LIB_BUILD_COVERAGE
 /****************************************************************************
@@ -345,6 +530,386 @@ static string intToString(const Cli::Convert & cvt, int val) {
     return tmp;
 }
 
+//===========================================================================
+// Adds the nodes and bucket array of an unordered map, but not memory owned
+// by its keys and values.
+template <typename M>
+static void addNodes(Cli::Footprint & out, const M & map) {
+    // Nodes have a next pointer and a cached hash along with the value.
+    auto node = sizeof(typename M::value_type) + 2 * sizeof(void *);
+    out.bytes += map.size() * node;
+    out.allocs += map.size();
+    if (map.bucket_count() > 1) {
+        out.bytes += map.bucket_count() * sizeof(void *);
+        out.allocs += 1;
+    }
+}
+
+
+/****************************************************************************
+*
+*   Arena
+*
+***/
+
+//===========================================================================
+void * Arena::allocate(size_t bytes, size_t align) {
+    for (;;) {
+        if (m_block < m_blocks.size()) {
+            auto & blk = m_blocks[m_block];
+            auto base = reinterpret_cast<uintptr_t>(blk.data.get());
+            auto pos = (base + m_used + align - 1) / align * align - base;
+            if (pos + bytes <= blk.size) {
+                m_used = pos + bytes;
+                return blk.data.get() + pos;
+            }
+            if (m_block + 1 < m_blocks.size()) {
+                m_block += 1;
+                m_used = 0;
+                continue;
+            }
+        }
+
+        // Out of blocks, add one that's at least twice the size of the last.
+        auto size = max(kMinArenaBlockSize, bytes + align);
+        if (!m_blocks.empty())
+            size = max(size, 2 * m_blocks.back().size);
+        m_blocks.push_back({unique_ptr<char[]>(new char[size]), size});
+        m_block = m_blocks.size() - 1;
+        m_used = 0;
+    }
+}
+
+//===========================================================================
+void Arena::reset() {
+    if (m_blocks.size() > 1) {
+        // Replace the blocks with a single one big enough to satisfy the
+        // whole previous parse, so it doesn't have to grow again next time.
+        size_t size = 0;
+        for (auto && blk : m_blocks)
+            size += blk.size;
+        m_blocks.clear();
+        m_blocks.push_back({unique_ptr<char[]>(new char[size]), size});
+    }
+    m_block = 0;
+    m_used = 0;
+}
+
+//===========================================================================
+void Arena::addFootprint(Cli::Footprint & out) const {
+    out.add(m_blocks);
+    for (auto && blk : m_blocks) {
+        out.bytes += blk.size;
+        out.allocs += 1;
+    }
+}
+
+
+/****************************************************************************
+*
+*   Cli::Convert::Interpreter
+*
+***/
+
+// Streams not currently lent out to a conversion, and the number that are.
+// The pool always has room for all of them, so giving one back to it from
+// the destructor never allocates.
+static thread_local vector<unique_ptr<stringstream>> t_interpreters;
+static thread_local size_t t_lentInterpreters;
+
+//===========================================================================
+Cli::Convert::Interpreter::Interpreter(const locale & loc) {
+    t_interpreters.reserve(t_interpreters.size() + t_lentInterpreters + 1);
+    if (t_interpreters.empty()) {
+        m_strm = make_unique<stringstream>();
+    } else {
+        m_strm = move(t_interpreters.back());
+        t_interpreters.pop_back();
+    }
+    if (m_strm->getloc() != loc)
+        m_strm->imbue(loc);
+    t_lentInterpreters += 1;
+}
+
+//===========================================================================
+Cli::Convert::Interpreter::~Interpreter() {
+    m_strm->clear();
+    m_strm->str({});
+    m_strm->flags(ios::skipws | ios::dec);
+    m_strm->fill(' ');
+    m_strm->precision(6);
+    m_strm->width(0);
+    t_lentInterpreters -= 1;
+    t_interpreters.push_back(move(m_strm));
+}
+
+
+/****************************************************************************
+*
+*   Cli::Convert
+*
+***/
+
+//===========================================================================
+const locale & Cli::Convert::getLocale() const {
+    if (!m_preferredLocale)
+        return m_locale;
+
+    // Creating the locale is expensive, so it's deferred until needed and
+    // then shared by everyone.
+    static const locale s_preferred("");
+    return s_preferred;
+}
+
+#if defined(__cpp_lib_to_chars)
+
+//===========================================================================
+static bool isSpace(char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+//===========================================================================
+static void trimSpace(const char *& first, const char *& last) {
+    while (first != last && isSpace(*first))
+        first += 1;
+    while (first != last && isSpace(last[-1]))
+        last -= 1;
+}
+
+//===========================================================================
+// Returns true if, when parsed, src would be interpreted the same in the
+// locale as it would in the "C" locale.
+static bool isPlainNumber(const locale & loc, const string & src) {
+    auto & np = use_facet<numpunct<char>>(loc);
+    if (np.decimal_point() != '.')
+        return false;
+    return np.grouping().empty()
+        || src.find(np.thousands_sep()) == string::npos;
+}
+
+//===========================================================================
+// Returns true if the formatted number, which has "digits" digits before
+// the decimal point, would look the same in the locale as it does in the
+// "C" locale.
+static bool isPlainNumber(const locale & loc, size_t digits) {
+    auto & np = use_facet<numpunct<char>>(loc);
+    if (np.decimal_point() != '.')
+        return false;
+    auto grouping = np.grouping();
+    return grouping.empty()
+        || grouping[0] <= 0
+        || grouping[0] == CHAR_MAX
+        || digits <= (size_t) grouping[0];
+}
+
+//===========================================================================
+static size_t countDigits(const char * first, const char * last) {
+    if (first != last && *first == '-')
+        first += 1;
+    auto ptr = first;
+    while (ptr != last && *ptr >= '0' && *ptr <= '9')
+        ptr += 1;
+    return ptr - first;
+}
+
+#endif
+
+//===========================================================================
+// Integers are in decimal, or in hex or octal when prefixed with "0x" or
+// "0o" respectively. An optional sign and surrounding whitespace are
+// allowed.
+Cli::Convert::NumParse Cli::Convert::parseNumber(
+    bool & neg,
+    unsigned long long & out,
+    const string & src
+) const {
+#if defined(__cpp_lib_to_chars)
+    if (!isPlainNumber(getLocale(), src))
+        return NumParse::kUseStream;
+    auto ptr = src.data();
+    auto last = ptr + src.size();
+    trimSpace(ptr, last);
+    neg = false;
+    if (ptr != last && (*ptr == '+' || *ptr == '-')) {
+        neg = *ptr == '-';
+        ptr += 1;
+    }
+    int base = 10;
+    if (last - ptr > 2 && ptr[0] == '0') {
+        if (ptr[1] == 'x' || ptr[1] == 'X') {
+            base = 16;
+            ptr += 2;
+        } else if (ptr[1] == 'o' || ptr[1] == 'O') {
+            base = 8;
+            ptr += 2;
+        }
+    }
+    auto res = from_chars(ptr, last, out, base);
+    if (res.ec != errc{} || res.ptr != last)
+        return NumParse::kInvalid;
+    return NumParse::kValid;
+#else
+    (void) neg;
+    (void) out;
+    (void) src;
+    return NumParse::kUseStream;
+#endif
+}
+
+//===========================================================================
+Cli::Convert::NumParse Cli::Convert::parseNumber(
+    float & out,
+    const string & src
+) const {
+    return parseFloat(out, src);
+}
+
+//===========================================================================
+Cli::Convert::NumParse Cli::Convert::parseNumber(
+    double & out,
+    const string & src
+) const {
+    return parseFloat(out, src);
+}
+
+//===========================================================================
+Cli::Convert::NumParse Cli::Convert::parseNumber(
+    long double & out,
+    const string & src
+) const {
+    return parseFloat(out, src);
+}
+
+//===========================================================================
+template <typename T>
+Cli::Convert::NumParse Cli::Convert::parseFloat(
+    T & out,
+    const string & src
+) const {
+#if defined(__cpp_lib_to_chars)
+    if (!isPlainNumber(getLocale(), src))
+        return NumParse::kUseStream;
+    auto ptr = src.data();
+    auto last = ptr + src.size();
+    trimSpace(ptr, last);
+    auto first = ptr;
+    if (ptr != last && (*ptr == '+' || *ptr == '-'))
+        ptr += 1;
+    // Reject "inf" and "nan", which from_chars accepts but iostreams don't.
+    if (ptr == last || ((*ptr < '0' || *ptr > '9') && *ptr != '.'))
+        return NumParse::kInvalid;
+    if (*first == '-')
+        ptr = first;
+    auto res = from_chars(ptr, last, out);
+    if (res.ec == errc::result_out_of_range) {
+        // Let iostreams sort out whether it's an overflow (error) or an
+        // underflow (zero).
+        return NumParse::kUseStream;
+    }
+    if (res.ec != errc{} || res.ptr != last)
+        return NumParse::kInvalid;
+    return NumParse::kValid;
+#else
+    (void) out;
+    (void) src;
+    return NumParse::kUseStream;
+#endif
+}
+
+//===========================================================================
+bool Cli::Convert::formatNumber(string & out, long long src) const {
+#if defined(__cpp_lib_to_chars)
+    char buf[32];
+    auto res = to_chars(buf, buf + sizeof buf, src);
+    if (!isPlainNumber(getLocale(), countDigits(buf, res.ptr)))
+        return false;
+    out.assign(buf, res.ptr);
+    return true;
+#else
+    (void) out;
+    (void) src;
+    return false;
+#endif
+}
+
+//===========================================================================
+bool Cli::Convert::formatNumber(string & out, unsigned long long src) const {
+#if defined(__cpp_lib_to_chars)
+    char buf[32];
+    auto res = to_chars(buf, buf + sizeof buf, src);
+    if (!isPlainNumber(getLocale(), countDigits(buf, res.ptr)))
+        return false;
+    out.assign(buf, res.ptr);
+    return true;
+#else
+    (void) out;
+    (void) src;
+    return false;
+#endif
+}
+
+//===========================================================================
+// Formatted the same as ostream with default flags, which is the same as
+// printf's "%g".
+bool Cli::Convert::formatNumber(string & out, double src) const {
+#if defined(__cpp_lib_to_chars)
+    char buf[64];
+    auto res = to_chars(buf, buf + sizeof buf, src, chars_format::general, 6);
+    if (res.ec != errc{}
+        || !isPlainNumber(getLocale(), countDigits(buf, res.ptr))
+    ) {
+        return false;
+    }
+    out.assign(buf, res.ptr);
+    return true;
+#else
+    (void) out;
+    (void) src;
+    return false;
+#endif
+}
+
+//===========================================================================
+bool Cli::Convert::formatNumber(string & out, long double src) const {
+#if defined(__cpp_lib_to_chars)
+    char buf[64];
+    auto res = to_chars(buf, buf + sizeof buf, src, chars_format::general, 6);
+    if (res.ec != errc{}
+        || !isPlainNumber(getLocale(), countDigits(buf, res.ptr))
+    ) {
+        return false;
+    }
+    out.assign(buf, res.ptr);
+    return true;
+#else
+    (void) out;
+    (void) src;
+    return false;
+#endif
+}
+
+//===========================================================================
+bool Cli::Convert::toRoundTripString(string & out, long double src) const {
+#if defined(__cpp_lib_to_chars)
+    char buf[64];
+    auto res = to_chars(buf, buf + sizeof buf, src);
+    if (res.ec == errc{}
+        && isPlainNumber(getLocale(), countDigits(buf, res.ptr))
+    ) {
+        out.assign(buf, res.ptr);
+        return true;
+    }
+#endif
+    Interpreter strm(getLocale());
+    strm->precision(numeric_limits<long double>::max_digits10);
+    if (!(*strm << src)) {
+        out.clear();
+        return false;
+    }
+    out = strm->str();
+    return true;
+}
+
 
 /****************************************************************************
 *
@@ -357,6 +922,25 @@ CliLocal::CliLocal()
     : Cli(make_shared<Config>())
 {}
 
+//===========================================================================
+// private
+CliLocal::CliLocal(const Cli & from)
+    : Cli(from)
+{}
+
+//===========================================================================
+CliLocal CliLocal::clone() {
+    freeze();
+    CliLocal out(*this);
+    Config::makeClone(out);
+    return out;
+}
+
+//===========================================================================
+Cli::Context * CliLocal::context() const {
+    return Config::cloneContext(*this);
+}
+
 
 /****************************************************************************
 *
@@ -375,12 +959,105 @@ void Cli::Config::touchAllCmds(Cli & cli) {
         Config::findCmdGrpAlways(cli, cmd.second.cmdGroup);
 }
 
+//===========================================================================
+// Returns the index of all options, visible or not, of the command. The index
+// is cached and only rebuilt when the definition has changed since it was
+// last built.
+// static
+const Cli::OptIndex & Cli::Config::findIndex(Cli & cli, const string & cmd) {
+    auto & cfg = *cli.m_cfg;
+    if (cfg.frozen) {
+        // Frozen configs have indexes for all commands and must not be
+        // changed, since other threads may be reading them.
+        auto i = cfg.ndxs.find(cmd);
+        if (i != cfg.ndxs.end())
+            return i->second;
+        assert(!"internal dimcli error: "   // LCOV_EXCL_LINE
+            "index of frozen command not found");
+    }
+    if (cfg.touchVersion != cfg.defVersion) {
+        touchAllCmds(cli);
+        cfg.touchVersion = cfg.defVersion;
+    }
+    auto & ndx = cfg.ndxs[cmd];
+    if (ndx.m_version != cfg.defVersion) {
+        ndx.index(cli, cmd, false);
+        ndx.m_version = cfg.defVersion;
+    }
+    return ndx;
+}
+
 //===========================================================================
 // static
 Cli::Config & Cli::Config::get(Cli & cli) {
     return *cli.m_cfg;
 }
 
+//===========================================================================
+// Returns the results of the parse, either of the context active on this
+// thread or, if it's not for this cli, of the config itself.
+// static
+Cli::Context::State & Cli::Config::state(const Cli & cli) {
+    auto ctx = t_context;
+    if (ctx && ctx->m_state->cfg == cli.m_cfg.get())
+        return *ctx->m_state;
+    if (cli.m_ctx)
+        return *cli.m_ctx->m_state;
+    return *cli.m_cfg->context.m_state;
+}
+
+//===========================================================================
+// Prepares context to be parsed into, giving it its own value proxies the
+// first time it's used with this cli.
+// static
+void Cli::Config::bind(Cli & cli, Context & ctx) {
+    auto & cfg = *cli.m_cfg;
+    if (!cfg.frozen) {
+        assert(!"cli must be frozen before parsing into a context");
+        cli.freeze();
+    }
+    auto & st = *ctx.m_state;
+    if (st.cfg == &cfg)
+        return;
+    st.cfg = &cfg;
+    st.proxies.clear();
+}
+
+//===========================================================================
+// Gives the clone its own context, bound to the shared definition.
+// static
+void Cli::Config::makeClone(Cli & clone) {
+    clone.m_ctx = make_shared<Context>();
+    bind(clone, *clone.m_ctx);
+}
+
+//===========================================================================
+// static
+Cli::Context * Cli::Config::cloneContext(const Cli & cli) {
+    return cli.m_ctx.get();
+}
+
+//===========================================================================
+// Context of the clone if neither it, nor any other context of the same
+// cli, is active on this thread. In which case the caller must make it active
+// before going on.
+// static
+Cli::Context * Cli::Config::pendingContext(const Cli & cli) {
+    if (!cli.m_ctx)
+        return nullptr;
+    auto ctx = t_context;
+    if (ctx && ctx->m_state->cfg == cli.m_cfg.get())
+        return nullptr;
+    return cli.m_ctx.get();
+}
+
+//===========================================================================
+// static
+Cli::ResponseFileCache::State * Cli::Config::responseFileCache(Cli & cli) {
+    auto & cache = get(cli).rspCache;
+    return cache ? cache->m_state.get() : nullptr;
+}
+
 //===========================================================================
 // static
 CommandConfig & Cli::Config::findCmdAlways(Cli & cli) {
@@ -508,6 +1185,13 @@ Cli::Config::Config() {
     updateWidth(width);
 }
 
+//===========================================================================
+Cli::Config::~Config() {
+    // The options are in the slab, so only have to be destroyed.
+    for (auto && opt : opts)
+        opt->~OptBase();
+}
+
 //===========================================================================
 void Cli::Config::updateWidth(size_t width) {
     this->maxWidth = width;
@@ -519,6 +1203,154 @@ void Cli::Config::updateWidth(size_t width) {
 }
 
 
+/****************************************************************************
+*
+*   Cli::Context
+*
+***/
+
+//===========================================================================
+Cli::Context::Context()
+    : m_state(make_unique<State>())
+{}
+
+//===========================================================================
+Cli::Context::Context(Context && from) noexcept = default;
+
+//===========================================================================
+Cli::Context & Cli::Context::operator=(Context && from) noexcept = default;
+
+//===========================================================================
+Cli::Context::~Context() {}
+
+//===========================================================================
+int Cli::Context::exitCode() const {
+    return m_state->exitCode;
+}
+
+//===========================================================================
+const string & Cli::Context::errMsg() const {
+    return m_state->errMsg;
+}
+
+//===========================================================================
+const string & Cli::Context::errDetail() const {
+    return m_state->errDetail;
+}
+
+//===========================================================================
+const string & Cli::Context::progName() const {
+    return m_state->progName;
+}
+
+//===========================================================================
+const string & Cli::Context::commandMatched() const {
+    return m_state->command;
+}
+
+//===========================================================================
+const vector<string> & Cli::Context::unknownArgs() const {
+    return m_state->unknownArgs;
+}
+
+//===========================================================================
+void * Cli::Context::proxy(const OptBase & opt) const {
+    assert(opt.m_owner && opt.m_owner == m_state->cfg
+        && "option not from cli last parsed into context");
+    return m_state->proxy(opt);
+}
+
+//===========================================================================
+void * Cli::Context::State::proxy(const OptBase & opt) {
+    if (proxies.size() <= opt.m_slot)
+        proxies.resize(cfg->numSlots);
+    auto & ptr = proxies[opt.m_slot];
+    if (!ptr)
+        ptr = opt.newValueProxy();
+    return ptr.get();
+}
+
+//===========================================================================
+Cli::Context::Scope::Scope(Context & ctx)
+    : m_prev(t_context)
+{
+    t_context = &ctx;
+}
+
+//===========================================================================
+Cli::Context::Scope::~Scope() {
+    t_context = m_prev;
+}
+
+
+/****************************************************************************
+*
+*   PhaseTimer
+*
+***/
+
+namespace {
+
+// Times a phase for cli.phaseEvents(), the phase that was already being
+// timed, if any, is paused until the timer is stopped.
+class PhaseTimer {
+public:
+    PhaseTimer(
+        Cli & cli,
+        Cli::Phase phase,
+        const Cli::OptBase * opt = nullptr
+    );
+    ~PhaseTimer() { stop(); }
+    void stop();
+
+private:
+    Cli::Context::State * m_st {}; // null when timing is disabled or stopped
+    Cli::Phase m_outer {Cli::kPhases};
+    const Cli::OptBase * m_outerOpt {};
+};
+
+} // namespace
+
+//===========================================================================
+static void endPhase(Cli::Context::State & st, steady_clock::time_point now) {
+    if (st.phase != Cli::kPhases) {
+        st.phaseEvents.push_back(
+            {st.phase, st.phaseStart, now - st.phaseStart, st.phaseOpt}
+        );
+    }
+}
+
+//===========================================================================
+PhaseTimer::PhaseTimer(
+    Cli & cli,
+    Cli::Phase phase,
+    const Cli::OptBase * opt
+) {
+    if (!Cli::Config::get(cli).phaseTiming)
+        return;
+    m_st = &Cli::Config::state(cli);
+    auto now = steady_clock::now();
+    endPhase(*m_st, now);
+    m_outer = m_st->phase;
+    m_outerOpt = m_st->phaseOpt;
+    m_st->phase = phase;
+    m_st->phaseOpt = opt;
+    m_st->phaseStart = now;
+}
+
+//===========================================================================
+void PhaseTimer::stop() {
+    if (!m_st)
+        return;
+    auto now = steady_clock::now();
+    endPhase(*m_st, now);
+    m_st->phase = m_outer;
+    m_st->phaseOpt = m_outerOpt;
+    m_st->phaseStart = now;
+    m_st = nullptr;
+}
+
+
 /****************************************************************************
 *
 *   Cli::OptBase
@@ -537,7 +1369,10 @@ Cli::OptBase::OptBase(const string & names, bool flag)
 
 //===========================================================================
 locale Cli::OptBase::imbue(const locale & loc) {
-    return m_interpreter.imbue(loc);
+    auto prev = getLocale();
+    m_locale = loc;
+    m_preferredLocale = false;
+    return prev;
 }
 
 //===========================================================================
@@ -556,6 +1391,47 @@ void Cli::OptBase::setNameIfEmpty(const string & name) {
         m_fromName = name;
 }
 
+//===========================================================================
+Cli::Footprint Cli::OptBase::footprint() const {
+    MemoryStats tmp;
+    addFootprint(tmp);
+    tmp.options += tmp.help;
+    return tmp.options;
+}
+
+//===========================================================================
+void Cli::OptBase::addFootprint(MemoryStats & out) const {
+    out.options.add(m_command);
+    out.options.add(m_group);
+    out.options.add(m_names);
+    out.options.add(m_fromName);
+    out.help.add(m_desc);
+    out.help.add(m_valueDesc);
+    out.help.add(m_defaultDesc);
+    addNodes(out.options, m_choiceDescs);
+    for (auto && kv : m_choiceDescs) {
+        out.options.add(kv.first);
+        out.options.add(kv.second.sortKey);
+        out.help.add(kv.second.desc);
+    }
+}
+
+//===========================================================================
+void Cli::OptBase::touchDefinition() {
+    if (m_owner) {
+        assert(!m_owner->frozen && "option changed after cli was frozen");
+        m_owner->defVersion += 1;
+    }
+}
+
+//===========================================================================
+void * Cli::OptBase::findContextProxy() const {
+    auto ctx = t_context;
+    if (!ctx || !m_owner || ctx->m_state->cfg != m_owner)
+        return nullptr;
+    return ctx->m_state->proxy(*this);
+}
+
 //===========================================================================
 bool Cli::OptBase::withUnits(
     long double & out,
@@ -564,7 +1440,7 @@ bool Cli::OptBase::withUnits(
     const unordered_map<string, long double> & units,
     int flags
 ) const {
-    auto & f = use_facet<ctype<char>>(m_interpreter.getloc());
+    auto & f = use_facet<ctype<char>>(getLocale());
 
     auto pos = val.size();
     for (;;) {
@@ -634,6 +1510,173 @@ void Cli::OptIndex::index(
         if (key.name.empty())
             key.name = "ARG" + to_string(i + 1);
     }
+
+    freezeLongNames();
+}
+
+//===========================================================================
+// FNV-1a followed by the murmur3 finalizer, so that hashes with different
+// seeds are independent enough to be used for perfect hashing.
+static unsigned hashName(const char name[], size_t len, unsigned seed) {
+    unsigned h = 0x811c9dc5 ^ seed;
+    for (auto i = 0u; i < len; ++i) {
+        h ^= (unsigned char) name[i];
+        h *= 0x01000193;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+//===========================================================================
+void Cli::OptIndex::freezeLongNames() {
+    // Remove duplicate names, the last one defined replaces the others.
+    {
+        unordered_map<string, size_t> found;
+        auto num = m_longNames.size();
+        for (unsigned i = 0; i < num; ++i) {
+            auto & nv = m_longNames[i];
+            auto ib = found.insert({nv.first, i});
+            if (!ib.second) {
+                m_longNames[ib.first->second].second = nv.second;
+                nv.first.clear();
+            }
+        }
+        if (found.size() != num) {
+            m_longNames.erase(
+                remove_if(
+                    m_longNames.begin(),
+                    m_longNames.end(),
+                    [](auto & nv) { return nv.first.empty(); }
+                ),
+                m_longNames.end()
+            );
+        }
+    }
+
+    // Hash and displace - names are distributed into buckets, then starting
+    // with the largest bucket, a seed is searched for that moves all of the
+    // bucket's names into unused slots.
+    auto num = (unsigned) m_longNames.size();
+    m_longSeeds.assign(num, 0);
+    m_longSlots.assign(num, 0);
+    if (!num)
+        return;
+    vector<vector<unsigned>> buckets(num);
+    for (unsigned i = 0; i < num; ++i) {
+        auto & name = m_longNames[i].first;
+        buckets[hashName(name.data(), name.size(), 0) % num].push_back(i);
+    }
+    vector<unsigned> order(num);
+    for (unsigned i = 0; i < num; ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    vector<bool> used(num);
+    vector<unsigned> slots;
+    unsigned nextFree = 0;
+    for (auto && bi : order) {
+        auto & bucket = buckets[bi];
+        if (bucket.size() <= 1) {
+            if (bucket.empty())
+                break;
+            // Single name buckets take the next unused slot directly.
+            while (used[nextFree])
+                nextFree += 1;
+            used[nextFree] = true;
+            m_longSeeds[bi] = -(int) nextFree - 1;
+            m_longSlots[nextFree] = bucket[0];
+            continue;
+        }
+        unsigned seed = 1;
+        for (; seed <= kMaxLongNameSeeds; ++seed) {
+            slots.clear();
+            for (auto && i : bucket) {
+                auto & name = m_longNames[i].first;
+                auto slot = hashName(name.data(), name.size(), seed) % num;
+                if (used[slot]
+                    || find(slots.begin(), slots.end(), slot) != slots.end()
+                ) {
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (slots.size() == bucket.size()) {
+                for (unsigned i = 0; i < slots.size(); ++i) {
+                    used[slots[i]] = true;
+                    m_longSlots[slots[i]] = bucket[i];
+                }
+                m_longSeeds[bi] = (int) seed;
+                break;
+            }
+        }
+        if (seed > kMaxLongNameSeeds)
+            return sortLongNames();
+    }
+}
+
+//===========================================================================
+// Fallback for when the names can't be perfectly hashed.
+void Cli::OptIndex::sortLongNames() {
+    m_longSeeds.clear();
+    m_longSlots.clear();
+    auto num = (unsigned) m_longNames.size();
+    m_longSorted.resize(num);
+    for (unsigned i = 0; i < num; ++i)
+        m_longSorted[i] = i;
+    sort(m_longSorted.begin(), m_longSorted.end(), [&](auto a, auto b) {
+        return m_longNames[a].first < m_longNames[b].first;
+    });
+}
+
+//===========================================================================
+const OptName * Cli::OptIndex::findShort(char name) const {
+    if (auto pos = m_shortTable[(unsigned char) name])
+        return &m_shortNames[pos - 1].second;
+    return nullptr;
+}
+
+//===========================================================================
+const OptName * Cli::OptIndex::findLong(
+    const char name[],
+    size_t len
+) const {
+    if (!m_longSorted.empty()) {
+        auto i = lower_bound(
+            m_longSorted.begin(),
+            m_longSorted.end(),
+            0,
+            [&](auto pos, int) {
+                auto & key = m_longNames[pos].first;
+                return key.compare(0, key.size(), name, len) < 0;
+            }
+        );
+        if (i == m_longSorted.end())
+            return nullptr;
+        auto & nv = m_longNames[*i];
+        if (nv.first.size() != len
+            || memcmp(nv.first.data(), name, len) != 0
+        ) {
+            return nullptr;
+        }
+        return &nv.second;
+    }
+    auto num = (unsigned) m_longSeeds.size();
+    if (!num)
+        return nullptr;
+    auto seed = m_longSeeds[hashName(name, len, 0) % num];
+    auto slot = seed < 0
+        ? (unsigned) (-seed - 1)
+        : hashName(name, len, seed) % num;
+    auto & nv = m_longNames[m_longSlots[slot]];
+    if (nv.first.size() != len || memcmp(nv.first.data(), name, len) != 0)
+        return nullptr;
+    return &nv.second;
 }
 
 //===========================================================================
@@ -648,7 +1691,7 @@ vector<OptKey> Cli::OptIndex::findNamedOpts(
         auto list = nameList(cli, *opt, type);
         if (list.size()) {
             OptKey key;
-            key.opt = opt.get();
+            key.opt = opt;
             key.list = list;
 
             // Sort by group sort key followed by name list with leading
@@ -716,11 +1759,13 @@ string Cli::OptIndex::nameList(
     bool foundLong = false;
     bool optional = false;
 
-    // Names
+    // Names, the indexes are in declaration order, but a redefined name
+    // keeps its original place there, so they're sorted by position within
+    // the option.
     vector<const decltype(m_shortNames)::value_type *> snames;
     for (auto & sn : m_shortNames)
         snames.push_back(&sn);
-    sort(snames.begin(), snames.end(), [](auto & a, auto & b) {
+    stable_sort(snames.begin(), snames.end(), [](auto & a, auto & b) {
         return a->second.pos < b->second.pos;
     });
     for (auto && sn : snames) {
@@ -735,7 +1780,7 @@ string Cli::OptIndex::nameList(
     vector<const decltype(m_longNames)::value_type *> lnames;
     for (auto & ln : m_longNames)
         lnames.push_back(&ln);
-    sort(lnames.begin(), lnames.end(), [](auto & a, auto & b) {
+    stable_sort(lnames.begin(), lnames.end(), [](auto & a, auto & b) {
         return a->second.pos < b->second.pos;
     });
     for (auto && ln : lnames) {
@@ -906,7 +1951,14 @@ void Cli::OptIndex::indexShortName(
     bool optional,
     int pos
 ) {
-    m_shortNames[name] = {&opt, invert, optional, {}, pos};
+    OptName oname = {&opt, invert, optional, "-"s + name, pos};
+    auto & ipos = m_shortTable[(unsigned char) name];
+    if (ipos) {
+        m_shortNames[ipos - 1].second = oname;
+    } else {
+        m_shortNames.push_back({name, oname});
+        ipos = (unsigned short) m_shortNames.size();
+    }
     opt.setNameIfEmpty("-"s + name);
 }
 
@@ -929,9 +1981,13 @@ void Cli::OptIndex::indexLongName(
         key.pop_back();
     }
     opt.setNameIfEmpty("--" + key);
-    m_longNames[key] = {&opt, invert, optional, {}, pos};
-    if (allowNo && opt.m_bool && !opt.m_flagValue)
-        m_longNames["no-" + key] = {&opt, !invert, optional, {}, pos + 1};
+    // Duplicates are removed when the index is frozen.
+    m_longNames.push_back({key, {&opt, invert, optional, "--" + key, pos}});
+    if (allowNo && opt.m_bool && !opt.m_flagValue) {
+        m_longNames.push_back(
+            {"no-" + key, {&opt, !invert, optional, "--no-" + key, pos + 1}}
+        );
+    }
 }
 
 
@@ -946,7 +2002,13 @@ void Cli::OptIndex::indexLongName(
 bool Cli::defParseAction(Cli & cli, OptBase & opt, const string & val) {
     if (opt.parseValue(val))
         return true;
+    return badParse(cli, opt, val);
+}
 
+//===========================================================================
+// Reports the value that the option couldn't parse.
+// static
+bool Cli::badParse(Cli & cli, OptBase & opt, const string & val) {
     string desc;
     writeChoicesDetail(&desc, opt.m_choiceDescs);
     return cli.badUsage(opt, val, desc);
@@ -997,10 +2059,11 @@ static void defCmdAction(Cli & cli) {
 
 //===========================================================================
 static void helpCmdAction(Cli & cli) {
-    Cli::OptIndex ndx;
-    ndx.index(cli, cli.commandMatched(), false);
+    auto & ndx = Cli::Config::findIndex(cli, cli.commandMatched());
     auto cmd = *static_cast<Cli::Opt<string> &>(*ndx.m_argNames[0].opt);
-    auto usage = *static_cast<Cli::Opt<bool> &>(*ndx.m_shortNames['u'].opt);
+    auto usage = *static_cast<Cli::Opt<bool> &>(
+        *ndx.findShort('u')->opt
+    );
     if (!cli.commandExists(cmd)) {
         cli.badUsage("Help requested for unknown command", cmd);
         return;
@@ -1036,6 +2099,7 @@ Cli::Cli()
 //===========================================================================
 Cli::Cli(const Cli & from)
     : m_cfg(from.m_cfg)
+    , m_ctx(from.m_ctx)
     , m_group(from.m_group)
     , m_command(from.m_command)
 {}
@@ -1051,6 +2115,7 @@ Cli::Cli(shared_ptr<Config> cfg)
 //===========================================================================
 Cli & Cli::operator=(const Cli & from) {
     m_cfg = from.m_cfg;
+    m_ctx = from.m_ctx;
     m_group = from.m_group;
     m_command = from.m_command;
     return *this;
@@ -1059,6 +2124,7 @@ Cli & Cli::operator=(const Cli & from) {
 //===========================================================================
 Cli & Cli::operator=(Cli && from) noexcept {
     m_cfg = move(from.m_cfg);
+    m_ctx = move(from.m_ctx);
     m_group = move(from.m_group);
     m_command = move(from.m_command);
     return *this;
@@ -1360,6 +2426,50 @@ Cli && Cli::responseFiles(bool enable) && {
     return move(responseFiles(enable));
 }
 
+//===========================================================================
+Cli & Cli::responseFileThreads(unsigned threads) & {
+    m_cfg->responseFileThreads = threads;
+    return *this;
+}
+
+//===========================================================================
+Cli && Cli::responseFileThreads(unsigned threads) && {
+    return move(responseFileThreads(threads));
+}
+
+//===========================================================================
+Cli & Cli::responseFileCache(shared_ptr<ResponseFileCache> cache) & {
+    m_cfg->rspCache = move(cache);
+    return *this;
+}
+
+//===========================================================================
+Cli && Cli::responseFileCache(shared_ptr<ResponseFileCache> cache) && {
+    return move(responseFileCache(move(cache)));
+}
+
+//===========================================================================
+Cli & Cli::phaseTiming(bool enable) & {
+    m_cfg->phaseTiming = enable;
+    return *this;
+}
+
+//===========================================================================
+Cli && Cli::phaseTiming(bool enable) && {
+    return move(phaseTiming(enable));
+}
+
+//===========================================================================
+Cli & Cli::lazyReset(bool enable) & {
+    m_cfg->lazyReset = enable;
+    return *this;
+}
+
+//===========================================================================
+Cli && Cli::lazyReset(bool enable) && {
+    return move(lazyReset(enable));
+}
+
 //===========================================================================
 Cli & Cli::iostreams(istream * in, ostream * out) & {
     m_cfg->conin = in ? in : &cin;
@@ -1398,22 +2508,158 @@ Cli && Cli::maxWidth(int maxW, int minDescCol, int maxDescCol) && {
 }
 
 //===========================================================================
-void Cli::addOpt(unique_ptr<OptBase> src) {
-    m_cfg->opts.push_back(move(src));
+// static
+void * Cli::allocSlab(Config & cfg, size_t bytes, size_t align) {
+    return cfg.slab.allocate(bytes, align);
+}
+
+//===========================================================================
+void Cli::addOpt(OptBase * src) {
+    assert(!m_cfg->frozen && "option added after cli was frozen");
+    src->m_owner = m_cfg.get();
+    m_cfg->optsByValue.insert({src->valueAddress(), src});
+    m_cfg->opts.push_back(src);
+    if (src->externalValue())
+        m_cfg->boundOpts.push_back(src);
+    if (m_cfg->lazyActive)
+        src->m_generation = &m_cfg->generation;
+    m_cfg->defVersion += 1;
 }
 
 //===========================================================================
 Cli::OptBase * Cli::findOpt(const void * value) {
     if (value) {
-        for (auto && opt : m_cfg->opts) {
-            if (opt->sameValue(value))
-                return opt.get();
-        }
+        auto i = m_cfg->optsByValue.find(value);
+        if (i != m_cfg->optsByValue.end())
+            return i->second;
     }
     return nullptr;
 }
 
 
+/****************************************************************************
+*
+*   CharSet
+*
+***/
+
+namespace {
+
+// Set of up to kMaxChars chars, used by the tokenizers to find the next
+// char that isn't simply appended to the argument, so that the runs of
+// plain chars in between can be copied in bulk.
+class CharSet {
+public:
+    static const unsigned kMaxChars = 10;
+
+    template <size_t N>
+    constexpr CharSet(const char (&chars)[N]);
+
+    bool contains(char ch) const;
+
+    // Returns the first char in [ptr, last) that's in the set, or last if
+    // there are none. Searches in 16 byte blocks when SSE2 is available.
+    const char * find(const char * ptr, const char * last) const;
+
+    // Same as find(), but always one char at a time.
+    const char * findScalar(const char * ptr, const char * last) const;
+
+private:
+    uint64_t m_bits[4] {};
+    char m_chars[kMaxChars] {};
+    unsigned m_count {};
+};
+
+} // namespace
+
+//===========================================================================
+template <size_t N>
+constexpr CharSet::CharSet(const char (&chars)[N]) {
+    static_assert(N - 1 <= kMaxChars, "too many chars in set");
+    for (size_t i = 0; i < N - 1; ++i) {
+        auto ch = (unsigned char) chars[i];
+        m_bits[ch / 64] |= uint64_t(1) << ch % 64;
+        m_chars[m_count++] = chars[i];
+    }
+}
+
+//===========================================================================
+bool CharSet::contains(char ch) const {
+    auto uch = (unsigned char) ch;
+    return (m_bits[uch / 64] >> uch % 64) & 1;
+}
+
+#ifdef DIMCLI_SSE2
+//===========================================================================
+static unsigned firstSetBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long pos;
+    _BitScanForward(&pos, mask);
+    return pos;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+//===========================================================================
+const char * CharSet::find(const char * ptr, const char * last) const {
+#ifdef DIMCLI_SSE2
+    if (last - ptr >= 16) {
+        __m128i chars[kMaxChars];
+        for (unsigned i = 0; i < m_count; ++i)
+            chars[i] = _mm_set1_epi8(m_chars[i]);
+        for (; last - ptr >= 16; ptr += 16) {
+            auto blk = _mm_loadu_si128((const __m128i *) ptr);
+            auto hits = _mm_cmpeq_epi8(blk, chars[0]);
+            for (unsigned i = 1; i < m_count; ++i)
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(blk, chars[i]));
+            if (auto mask = (unsigned) _mm_movemask_epi8(hits))
+                return ptr + firstSetBit(mask);
+        }
+    }
+#endif
+    return findScalar(ptr, last);
+}
+
+//===========================================================================
+const char * CharSet::findScalar(const char * ptr, const char * last) const {
+    for (; ptr < last; ++ptr) {
+        if (contains(*ptr))
+            break;
+    }
+    return ptr;
+}
+
+namespace {
+
+// Chars that end a run of plain chars in each state of the tokenizers.
+constexpr CharSet kUnquoted("\\\"' \t\r\n\f\v");
+constexpr CharSet kSingleQuoted("'");
+constexpr CharSet kDoubleQuoted("\"\\");
+constexpr CharSet kLineEnds("\r\n");
+constexpr CharSet kGnuSingleQuoted("'\\");
+constexpr CharSet kWindowsUnquoted("\\\" \t\r\n");
+constexpr CharSet kWindowsQuoted("\\\"");
+
+} // namespace
+
+//===========================================================================
+// Appends the run of plain chars at cur to the argument, and returns false
+// if that reaches the end of the input.
+static bool appendPlain(
+    string & arg,
+    const char *& cur,
+    const char * last,
+    const CharSet & specials
+) {
+    auto end = specials.find(cur, last);
+    arg.append(cur, end);
+    cur = end;
+    return cur < last;
+}
+
+
 /****************************************************************************
 *
 *   Parse argv
@@ -1502,11 +2748,8 @@ vector<const char *> Cli::toPtrArgv(const vector<string> & args) {
 //   Must: | & ; < > ( ) $ ` \ " ' SP TAB CR LF FF VTAB
 //   Should: * ? [ # ~ = %
 //===========================================================================
-// static
-vector<string> Cli::toGlibArgv(const string & cmdline) {
+static vector<string> toGlibArgv(const char * cur, const char * last) {
     vector<string> out;
-    const char * cur = cmdline.c_str();
-    const char * last = cur + cmdline.size();
 
     string arg;
 
@@ -1537,17 +2780,15 @@ IN_GAP:
     return out;
 
 IN_COMMENT:
-    while (cur < last) {
-        char ch = *cur++;
-        switch (ch) {
-        case '\r':
-        case '\n': goto IN_GAP;
-        }
+    cur = kLineEnds.find(cur, last);
+    if (cur < last) {
+        cur += 1;
+        goto IN_GAP;
     }
     return out;
 
 IN_UNQUOTED:
-    while (cur < last) {
+    while (appendPlain(arg, cur, last, kUnquoted)) {
         char ch = *cur++;
         switch (ch) {
         case '\\':
@@ -1576,17 +2817,15 @@ IN_UNQUOTED:
     return out;
 
 IN_SQUOTE:
-    while (cur < last) {
-        char ch = *cur++;
-        if (ch == '\'')
-            goto IN_UNQUOTED;
-        arg += ch;
+    if (appendPlain(arg, cur, last, kSingleQuoted)) {
+        cur += 1;
+        goto IN_UNQUOTED;
     }
     out.push_back(move(arg));
     return out;
 
 IN_DQUOTE:
-    while (cur < last) {
+    while (appendPlain(arg, cur, last, kDoubleQuoted)) {
         char ch = *cur++;
         switch (ch) {
         case '"': goto IN_UNQUOTED;
@@ -1618,11 +2857,8 @@ IN_DQUOTE:
 //  - backslashes: always escapes the following character.
 //  - single quotes and double quotes: escape each other and whitespace.
 //===========================================================================
-// static
-vector<string> Cli::toGnuArgv(const string & cmdline) {
+static vector<string> toGnuArgv(const char * cur, const char * last) {
     vector<string> out;
-    const char * cur = cmdline.c_str();
-    const char * last = cur + cmdline.size();
 
     string arg;
     char quote;
@@ -1650,7 +2886,7 @@ IN_GAP:
     return out;
 
 IN_UNQUOTED:
-    while (cur < last) {
+    while (appendPlain(arg, cur, last, kUnquoted)) {
         char ch = *cur++;
         switch (ch) {
         case '\\':
@@ -1677,7 +2913,12 @@ IN_UNQUOTED:
 
 
 IN_QUOTED:
-    while (cur < last) {
+    while (appendPlain(
+        arg,
+        cur,
+        last,
+        quote == '"' ? kDoubleQuoted : kGnuSingleQuoted
+    )) {
         char ch = *cur++;
         if (ch == quote)
             goto IN_UNQUOTED;
@@ -1702,11 +2943,8 @@ IN_QUOTED:
 //     pair, the last one is tossed, and the quote is added to the argument.
 //   - any number not followed by a double quote are literals.
 //===========================================================================
-// static
-vector<string> Cli::toWindowsArgv(const string & cmdline) {
+static vector<string> toWindowsArgv(const char * cur, const char * last) {
     vector<string> out;
-    const char * cur = cmdline.c_str();
-    const char * last = cur + cmdline.size();
 
     string arg;
     int backslashes = 0;
@@ -1717,6 +2955,16 @@ vector<string> Cli::toWindowsArgv(const string & cmdline) {
             backslashes = 0;
         }
     };
+    // Pending backslashes are literals when followed by plain chars.
+    auto appendRun = [&](const CharSet & specials) {
+        auto end = specials.find(cur, last);
+        if (end != cur) {
+            appendBackslashes();
+            arg.append(cur, end);
+            cur = end;
+        }
+        return cur < last;
+    };
 
 IN_GAP:
     while (cur < last) {
@@ -1734,7 +2982,7 @@ IN_GAP:
     return out;
 
 IN_UNQUOTED:
-    while (cur < last) {
+    while (appendRun(kWindowsUnquoted)) {
         char ch = *cur++;
         switch (ch) {
         case '\\': backslashes += 1; break;
@@ -1767,7 +3015,7 @@ IN_UNQUOTED:
     return out;
 
 IN_QUOTED:
-    while (cur < last) {
+    while (appendRun(kWindowsQuoted)) {
         char ch = *cur++;
         switch (ch) {
         case '\\': backslashes += 1; break;
@@ -1792,6 +3040,35 @@ IN_QUOTED:
     return out;
 }
 
+//===========================================================================
+// Splits the chars in [cur, last) with the rules of the platform, as
+// cli.toArgv(cmdline) does.
+static vector<string> toArgv(const char * cur, const char * last) {
+#if defined(_WIN32)
+    return toWindowsArgv(cur, last);
+#else
+    return toGnuArgv(cur, last);
+#endif
+}
+
+//===========================================================================
+// static
+vector<string> Cli::toGlibArgv(const string & cmdline) {
+    return ::toGlibArgv(cmdline.data(), cmdline.data() + cmdline.size());
+}
+
+//===========================================================================
+// static
+vector<string> Cli::toGnuArgv(const string & cmdline) {
+    return ::toGnuArgv(cmdline.data(), cmdline.data() + cmdline.size());
+}
+
+//===========================================================================
+// static
+vector<string> Cli::toWindowsArgv(const string & cmdline) {
+    return ::toWindowsArgv(cmdline.data(), cmdline.data() + cmdline.size());
+}
+
 
 /****************************************************************************
 *
@@ -1932,6 +3209,127 @@ string Cli::toWindowsCmdline(size_t, char * argv[]) {
 }
 
 
+/****************************************************************************
+*
+*   Cli::ResponseFileCache
+*
+***/
+
+namespace {
+
+// Identifies a version of a file, a different id for the same path means
+// the file was changed or replaced.
+struct FileId {
+    uint64_t dev {};
+    uint64_t ino {};
+    uint64_t size {};
+    int64_t mtime {};
+    int64_t mtimeNsec {};
+
+    bool operator==(const FileId & other) const {
+        return dev == other.dev
+            && ino == other.ino
+            && size == other.size
+            && mtime == other.mtime
+            && mtimeNsec == other.mtimeNsec;
+    }
+};
+
+struct CachedFile {
+    string path;        // as named, after being made relative to its parent
+    FileId id;
+    string canonical;
+    vector<string> args;
+    size_t bytes;       // memory charged to the cache
+};
+
+} // namespace
+
+struct Cli::ResponseFileCache::State {
+    mutable mutex mut;
+    size_t maxBytes;
+    size_t bytes {};
+
+    // Files from most to least recently used, and indexed by path.
+    list<shared_ptr<const CachedFile>> lru;
+    unordered_map<string, decltype(lru)::iterator> files;
+
+    shared_ptr<const CachedFile> find(const string & path, const FileId & id);
+    void insert(shared_ptr<CachedFile> file);
+    void erase(decltype(lru)::iterator it);
+};
+
+//===========================================================================
+// Returns the file if it's cached and still the same version.
+shared_ptr<const CachedFile> Cli::ResponseFileCache::State::find(
+    const string & path,
+    const FileId & id
+) {
+    lock_guard<mutex> lk{mut};
+    auto i = files.find(path);
+    if (i == files.end() || !((*i->second)->id == id))
+        return nullptr;
+    lru.splice(lru.begin(), lru, i->second);
+    return lru.front();
+}
+
+//===========================================================================
+void Cli::ResponseFileCache::State::insert(shared_ptr<CachedFile> file) {
+    file->bytes = sizeof *file + file->path.size() + file->canonical.size();
+    for (auto && arg : file->args)
+        file->bytes += sizeof arg + arg.size();
+    if (file->bytes > maxBytes)
+        return;
+
+    lock_guard<mutex> lk{mut};
+    auto i = files.find(file->path);
+    if (i != files.end())
+        erase(i->second);
+    bytes += file->bytes;
+    lru.push_front(file);
+    files[file->path] = lru.begin();
+    while (bytes > maxBytes)
+        erase(prev(lru.end()));
+}
+
+//===========================================================================
+void Cli::ResponseFileCache::State::erase(decltype(lru)::iterator it) {
+    bytes -= (*it)->bytes;
+    files.erase((*it)->path);
+    lru.erase(it);
+}
+
+//===========================================================================
+Cli::ResponseFileCache::ResponseFileCache(size_t maxBytes)
+    : m_state(make_unique<State>())
+{
+    m_state->maxBytes = maxBytes;
+}
+
+//===========================================================================
+Cli::ResponseFileCache::~ResponseFileCache() {}
+
+//===========================================================================
+void Cli::ResponseFileCache::clear() {
+    lock_guard<mutex> lk{m_state->mut};
+    m_state->lru.clear();
+    m_state->files.clear();
+    m_state->bytes = 0;
+}
+
+//===========================================================================
+size_t Cli::ResponseFileCache::size() const {
+    lock_guard<mutex> lk{m_state->mut};
+    return m_state->lru.size();
+}
+
+//===========================================================================
+size_t Cli::ResponseFileCache::bytes() const {
+    lock_guard<mutex> lk{m_state->mut};
+    return m_state->bytes;
+}
+
+
 /****************************************************************************
 *
 *   Response files
@@ -1941,18 +3339,81 @@ string Cli::toWindowsCmdline(size_t, char * argv[]) {
 #ifdef DIMCLI_LIB_FILESYSTEM
 
 // forward declarations
-static bool expandResponseFiles(
+static bool appendExpanded(
     Cli & cli,
-    vector<string> & args,
+    vector<string> & out,
+    vector<string>::iterator first,
+    vector<string>::iterator last,
     vector<string> & ancestors
 );
 
+namespace {
+
+// Content of a response file, either mapped into memory or read into buf.
+// When the file starts with a byte order mark the data starts after it, or
+// is in buf after having been converted from UTF-16.
+struct FileContent {
+    const char * data {};
+    size_t size {};
+    string buf;
+#ifdef DIMCLI_MMAP
+    void * map {};
+    size_t mapLen {};
+#endif
+
+    FileContent() = default;
+    FileContent(const FileContent &) = delete;
+    FileContent & operator=(const FileContent &) = delete;
+    ~FileContent();
+};
+
+} // namespace
+
 //===========================================================================
-// Returns false on error, if there was an error content will either be empty
-// or - if there was a transcoding error - contain the original content.
-static bool loadFileUtf8(string & content, const fs::path & fn) {
-    content.clear();
+FileContent::~FileContent() {
+#ifdef DIMCLI_MMAP
+    if (map)
+        munmap(map, mapLen);
+#endif
+}
+
+//===========================================================================
+// Maps regular files that are large enough for it to be worthwhile. Returns
+// false if the file wasn't mapped and must be read instead, which is always
+// the case for pipes and other special files.
+static bool mapFile(FileContent & content, const fs::path & fn) {
+#ifdef DIMCLI_MMAP
+    auto fd = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    void * map = MAP_FAILED;
+    if (fstat(fd, &st) == 0
+        && S_ISREG(st.st_mode)
+        && (size_t) st.st_size >= kMinMappedFileSize
+    ) {
+        auto len = (size_t) st.st_size;
+        map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    content.map = map;
+    content.mapLen = (size_t) st.st_size;
+    content.data = static_cast<const char *>(map);
+    content.size = content.mapLen;
+    return true;
+#else
+    (void) content;
+    (void) fn;
+    return false;
+#endif
+}
 
+//===========================================================================
+// Returns false on error, in which case content is left empty.
+static bool readFile(FileContent & content, const fs::path & fn) {
+    auto & buf = content.buf;
     error_code ec;
     auto bytes = (size_t) fs::file_size(fn, ec);
     if (ec) {
@@ -1963,86 +3424,320 @@ static bool loadFileUtf8(string & content, const fs::path & fn) {
         return false; // LCOV_EXCL_LINE
     }
 
-    content.resize(bytes);
+    buf.resize(bytes);
     ifstream f(fn, ios::binary);
-    f.read(const_cast<char *>(content.data()), content.size());
+    f.read(const_cast<char *>(buf.data()), buf.size());
     if (!f) {
-        content.clear();
+        buf.clear();
+        return false;
+    }
+    content.data = buf.data();
+    content.size = buf.size();
+    return true;
+}
+
+//===========================================================================
+// Returns false on error, if there was an error content will either be empty
+// or - if there was a transcoding error - contain the original content.
+static bool loadFileUtf8(FileContent & content, const fs::path & fn) {
+    if (!mapFile(content, fn) && !readFile(content, fn))
+        return false;
+
+    auto data = content.data;
+    auto size = content.size;
+    if (size < 2)
+        return true;
+    if (data[0] == '\xff' && data[1] == '\xfe') {
+        wstring_convert<CodecvtWchar> wcvt("");
+        auto base = reinterpret_cast<const wchar_t *>(data);
+        auto tmp = (string) wcvt.to_bytes(
+            base + 1,
+            base + size / sizeof *base
+        );
+        if (tmp.empty())
+            return false;
+        content.buf = move(tmp);
+        content.data = content.buf.data();
+        content.size = content.buf.size();
+    } else if (size >= 3
+        && data[0] == '\xef'
+        && data[1] == '\xbb'
+        && data[2] == '\xbf'
+    ) {
+        // Skip the byte order mark.
+        content.data += 3;
+        content.size -= 3;
+    }
+    return true;
+}
+
+//===========================================================================
+// Gets the id of the current version of the file with a single stat call,
+// or with separate queries of its size and modification time when POSIX
+// stat isn't available. Returns false if the file doesn't exist.
+static bool getFileId(FileId & out, const fs::path & fn) {
+#ifdef DIMCLI_MMAP
+    struct stat st;
+    if (stat(fn.c_str(), &st) != 0)
+        return false;
+    out.dev = (uint64_t) st.st_dev;
+    out.ino = (uint64_t) st.st_ino;
+    out.size = (uint64_t) st.st_size;
+    out.mtime = (int64_t) st.st_mtime;
+#if defined(__APPLE__)
+    out.mtimeNsec = (int64_t) st.st_mtimespec.tv_nsec;
+#else
+    out.mtimeNsec = (int64_t) st.st_mtim.tv_nsec;
+#endif
+    return true;
+#else
+    error_code ec;
+    out.size = (uint64_t) fs::file_size(fn, ec);
+    if (ec)
+        return false;
+    auto mtime = fs::last_write_time(fn, ec);
+    if (ec)
         return false;
+    out.mtime = (int64_t) mtime.time_since_epoch().count();
+    return true;
+#endif
+}
+
+namespace {
+
+// Response file being loaded, found and then read separately so that errors
+// are reported in the same order whether or not it was prefetched.
+struct LoadedFile {
+    enum Status {
+        kInvalid,       // doesn't exist
+        kFound,         // exists and needs to be read
+        kLoaded,        // args tokenized, or copied from the cache
+        kReadError,
+        kBadEncoding,
+    };
+    Status status {kInvalid};
+    fs::path path;
+    string canonical;
+    vector<string> args;
+
+    // Cache the args are added to once they're read, if any.
+    Cli::ResponseFileCache::State * cache {};
+    FileId id;
+};
+
+} // namespace
+
+//===========================================================================
+// Resolves the path and, if the file hasn't changed since it was cached,
+// gets its args from the cache.
+static void findResponseFile(
+    LoadedFile & file,
+    Cli::ResponseFileCache::State * cache,
+    const fs::path & path
+) {
+    file.path = path;
+    if (cache && getFileId(file.id, path)) {
+        if (auto cached = cache->find(path.string(), file.id)) {
+            file.canonical = cached->canonical;
+            file.args = cached->args;
+            file.status = LoadedFile::kLoaded;
+            return;
+        }
+        file.cache = cache;
+    }
+    error_code ec;
+    auto cfn = fs::canonical(path, ec);
+    if (ec || !fs::exists(cfn)) {
+        file.status = LoadedFile::kInvalid;
+        return;
     }
-    f.close();
+    file.canonical = cfn.string();
+    file.status = LoadedFile::kFound;
+}
 
-    if (content.size() < 2)
-        return true;
-    if (content[0] == '\xff' && content[1] == '\xfe') {
-        wstring_convert<CodecvtWchar> wcvt("");
-        auto base = reinterpret_cast<const wchar_t *>(content.data());
-        auto tmp = (string) wcvt.to_bytes(
-            base + 1,
-            base + content.size() / sizeof *base
-        );
-        if (tmp.empty())
-            return false;
-        content = tmp;
-    } else if (content.size() >= 3
-        && content[0] == '\xef'
-        && content[1] == '\xbb'
-        && content[2] == '\xbf'
-    ) {
-        content.erase(0, 3);
+//===========================================================================
+// Reads and tokenizes the file if it was found and wasn't cached.
+static void readResponseFile(LoadedFile & file) {
+    if (file.status != LoadedFile::kFound)
+        return;
+    FileContent content;
+    if (!loadFileUtf8(content, file.canonical)) {
+        file.status = content.size
+            ? LoadedFile::kBadEncoding
+            : LoadedFile::kReadError;
+        return;
+    }
+    file.args = toArgv(content.data, content.data + content.size);
+    file.status = LoadedFile::kLoaded;
+    if (file.cache) {
+        auto cached = make_shared<CachedFile>();
+        cached->path = file.path.string();
+        cached->id = file.id;
+        cached->canonical = file.canonical;
+        cached->args = file.args;
+        file.cache->insert(move(cached));
     }
-    return true;
 }
 
 //===========================================================================
-static bool expandResponseFile(
+// Appends the args in the response file named by arg ("@file") to out,
+// expanding any response files they refer to. Uses the prefetched file, if
+// there is one, instead of loading it.
+static bool appendResponseFile(
     Cli & cli,
-    vector<string> & args,
-    size_t & pos,
-    vector<string> & ancestors
+    vector<string> & out,
+    const string & arg,
+    vector<string> & ancestors,
+    LoadedFile * prefetched
 ) {
-    string content;
-    error_code ec;
-    auto fn = args[pos].substr(1);
-    auto cfn = ancestors.empty()
-        ? (fs::path) fn
-        : fs::path(ancestors.back()).parent_path() / fn;
-    cfn = fs::canonical(cfn, ec);
-    if (ec || !fs::exists(cfn))
+    auto fn = arg.substr(1);
+    LoadedFile tmp;
+    auto & file = prefetched ? *prefetched : tmp;
+    if (!prefetched) {
+        auto path = ancestors.empty()
+            ? (fs::path) fn
+            : fs::path(ancestors.back()).parent_path() / fn;
+        findResponseFile(file, Cli::Config::responseFileCache(cli), path);
+    }
+    if (file.status == LoadedFile::kInvalid)
         return cli.badUsage("Invalid response file", fn);
     for (auto && a : ancestors) {
-        if (a == cfn.string())
+        if (a == file.canonical)
             return cli.badUsage("Recursive response file", fn);
     }
-    ancestors.push_back(cfn.string());
-    if (!loadFileUtf8(content, cfn)) {
-        string desc = content.empty() ? "Read error" : "Invalid encoding";
-        return cli.badUsage(desc, fn);
-    }
-    auto rargs = cli.toArgv(content);
-    if (!expandResponseFiles(cli, rargs, ancestors))
+    ancestors.push_back(file.canonical);
+
+    readResponseFile(file);
+    if (file.status == LoadedFile::kReadError)
+        return cli.badUsage("Read error", fn);
+    if (file.status == LoadedFile::kBadEncoding)
+        return cli.badUsage("Invalid encoding", fn);
+    auto & rargs = file.args;
+    if (!appendExpanded(cli, out, rargs.begin(), rargs.end(), ancestors))
         return false;
-    auto rargLen = rargs.size();
-    replace(args, pos, 1, move(rargs));
-    pos += rargLen - 1;
     ancestors.pop_back();
     return true;
 }
 
 //===========================================================================
-// "ancestors" contains the set of response files these args came from,
-// directly or indirectly, and is used to detect recursive response files.
-static bool expandResponseFiles(
+// Moves the args in [first, last) to the end of out, replacing response
+// files with their expanded contents. "ancestors" contains the set of
+// response files these args came from, directly or indirectly, and is used
+// to detect recursive response files.
+static bool appendExpanded(
     Cli & cli,
-    vector<string> & args,
+    vector<string> & out,
+    vector<string>::iterator first,
+    vector<string>::iterator last,
     vector<string> & ancestors
 ) {
-    for (size_t pos = 0; pos < args.size(); ++pos) {
-        if (!args[pos].empty() && args[pos][0] == '@') {
-            if (!expandResponseFile(cli, args, pos, ancestors))
+    for (; first != last; ++first) {
+        if (!first->empty() && (*first)[0] == '@') {
+            if (!appendResponseFile(cli, out, *first, ancestors, nullptr))
+                return false;
+        } else {
+            out.push_back(move(*first));
+        }
+    }
+    return true;
+}
+
+//===========================================================================
+// Loads the response files named by the args in [first, last) concurrently
+// on up to "threads" threads, zero for one per hardware thread. Returns an
+// empty vector if there aren't enough files for it to be worthwhile.
+static vector<LoadedFile> prefetchResponseFiles(
+    Cli & cli,
+    vector<string>::iterator first,
+    vector<string>::iterator last,
+    unsigned threads
+) {
+    vector<const string *> names;
+    for (; first != last; ++first) {
+        if (!first->empty() && (*first)[0] == '@')
+            names.push_back(&*first);
+    }
+    vector<LoadedFile> files;
+    if (names.size() < 2)
+        return files;
+    files.resize(names.size());
+
+    auto cache = Cli::Config::responseFileCache(cli);
+    atomic<size_t> next {0};
+    auto worker = [&]() {
+        for (;;) {
+            auto i = next.fetch_add(1);
+            if (i >= files.size())
+                break;
+            findResponseFile(files[i], cache, names[i]->substr(1));
+            readResponseFile(files[i]);
+        }
+    };
+
+    if (!threads)
+        threads = max(thread::hardware_concurrency(), 1u);
+    if (threads > files.size())
+        threads = (unsigned) files.size();
+    vector<thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i)
+        pool.emplace_back(worker);
+    worker();
+    for (auto && th : pool)
+        th.join();
+    return files;
+}
+
+//===========================================================================
+// Builds the expanded args in a single pass, so the time taken is linear in
+// the number of args regardless of how many response files there are.
+static bool expandResponseFiles(Cli & cli, vector<string> & args) {
+    auto first = find_if(args.begin(), args.end(), [](auto & arg) {
+        return !arg.empty() && arg[0] == '@';
+    });
+    if (first == args.end())
+        return true;
+    vector<string> out;
+    out.reserve(args.size());
+    out.insert(
+        out.end(),
+        make_move_iterator(args.begin()),
+        make_move_iterator(first)
+    );
+
+    // Top level response files are loaded up front, and concurrently, when
+    // enabled. They're still expanded, and any errors reported, in order.
+    vector<LoadedFile> files;
+    auto threads = Cli::Config::get(cli).responseFileThreads;
+    if (threads != 1)
+        files = prefetchResponseFiles(cli, first, args.end(), threads);
+
+    // The args are moved to out as they're reached, remember where each one
+    // went so they can all be put back if the expansion fails.
+    auto base = (size_t) (first - args.begin());
+    vector<size_t> moved(args.size() - base, SIZE_MAX);
+    auto prefetched = files.empty() ? nullptr : files.data();
+    vector<string> ancestors;
+    for (auto i = base; i < args.size(); ++i) {
+        auto & arg = args[i];
+        if (!arg.empty() && arg[0] == '@') {
+            if (!appendResponseFile(cli, out, arg, ancestors, prefetched)) {
+                for (size_t j = 0; j < base; ++j)
+                    args[j] = move(out[j]);
+                for (auto j = base; j < args.size(); ++j) {
+                    if (moved[j - base] != SIZE_MAX)
+                        args[j] = move(out[moved[j - base]]);
+                }
                 return false;
+            }
+            if (prefetched)
+                prefetched += 1;
+        } else {
+            moved[i - base] = out.size();
+            out.push_back(move(arg));
         }
     }
+    args = move(out);
     return true;
 }
 
@@ -2112,14 +3807,34 @@ vector<pair<string, double>> Cli::siUnitMapping(
 
 //===========================================================================
 Cli & Cli::resetValues() & {
-    for (auto && opt : m_cfg->opts)
+    if (auto ctx = Config::pendingContext(*this)) {
+        Context::Scope scope(*ctx);
+        return resetValues();
+    }
+    auto & st = Config::state(*this);
+    auto & cfg = *m_cfg;
+    auto lazy = false;
+    if (&st == cfg.context.m_state.get()) {
+        // Lazy reset only applies to the values owned by the options, so
+        // parses into other contexts reset all of their proxies.
+        if (cfg.lazyReset != cfg.lazyActive) {
+            cfg.lazyActive = cfg.lazyReset;
+            auto gen = cfg.lazyActive ? &cfg.generation : nullptr;
+            for (auto && opt : cfg.opts)
+                opt->m_generation = gen;
+        } else {
+            lazy = cfg.lazyActive;
+        }
+        cfg.generation += 1;
+    }
+    for (auto && opt : lazy ? cfg.boundOpts : cfg.opts)
         opt->reset();
-    m_cfg->exitCode = kExitOk;
-    m_cfg->errMsg.clear();
-    m_cfg->errDetail.clear();
-    m_cfg->progName.clear();
-    m_cfg->command.clear();
-    m_cfg->unknownArgs.clear();
+    st.exitCode = kExitOk;
+    st.errMsg.clear();
+    st.errDetail.clear();
+    st.progName.clear();
+    st.command.clear();
+    st.unknownArgs.clear();
     return *this;
 }
 
@@ -2204,15 +3919,29 @@ bool Cli::parseValue(
     }
     string val;
     if (ptr) {
+        PhaseTimer timer(*this, kPhaseParse, &opt);
+        if (auto arg = ownedArg(pos, ptr)) {
+            if (opt.takeValue(*arg))
+                return true;
+        }
         val = ptr;
         if (!opt.doParseAction(*this, val))
             return false;
     } else {
         opt.assignImplicit();
     }
+    PhaseTimer timer(*this, kPhaseCheck, &opt);
     return opt.doCheckActions(*this, val);
 }
 
+//===========================================================================
+string * Cli::ownedArg(size_t pos, const char ptr[]) {
+    auto args = Config::state(*this).ownedArgs;
+    if (args && pos < args->size() && (*args)[pos].c_str() == ptr)
+        return &(*args)[pos];
+    return nullptr;
+}
+
 //===========================================================================
 bool Cli::badUsage(
     const string & prefix,
@@ -2243,9 +3972,10 @@ bool Cli::badUsage(
 
 //===========================================================================
 bool Cli::fail(int code, const string & msg, const string & detail) {
-    m_cfg->exitCode = code;
-    m_cfg->errMsg = format(*m_cfg, msg);
-    m_cfg->errDetail = format(*m_cfg, detail);
+    auto & st = Config::state(*this);
+    st.exitCode = code;
+    st.errMsg = format(*m_cfg, msg);
+    st.errDetail = format(*m_cfg, detail);
     return false;
 }
 
@@ -2334,7 +4064,10 @@ static bool assignOperands(
 ) {
     // Assign positional values to operands. There must be enough values for
     // all opts of a category for any of the next category to be eligible.
-    vector<int> matched(ndx.m_argNames.size());
+    ArenaVec<int> matched(
+        ndx.m_argNames.size(),
+        Cli::Config::state(cli).arena
+    );
     int usedPos = 0;
 
     for (auto&& cat : { OprCat::kMinReq, OprCat::kReq, OprCat::kOpt }) {
@@ -2368,7 +4101,7 @@ static bool assignOperands(
         }
         auto & argName = ndx.m_argNames[ipos];
         val->opt = argName.opt;
-        val->name = argName.name;
+        val->name = &argName.name;
         imatch += 1;
     }
     return true;
@@ -2405,30 +4138,20 @@ bool Cli::parse(vector<string> & args) {
     // The 0th (name of this program) opt must always be present.
     assert(!args.empty() 
         && "at least one argument (the program name) required");
+    if (auto ctx = Config::pendingContext(*this)) {
+        Context::Scope scope(*ctx);
+        return parse(args);
+    }
 
-    Config::touchAllCmds(*this);
-    OptIndex ndx;
-    ndx.index(*this, "", false);
-    enum {
-        kNone,
-        kPending,
-        kFound,
-        kUnknown
-    } cmdMode = m_cfg->allowUnknown || m_cfg->cmds.size() > 1
-        ? kPending
-        : kNone;
-
-    // Commands can't be added when the top level has an operand that requires
-    // look ahead to match, command processing requires that the command be
-    // unambiguously identifiable.
-    assert((ndx.m_allowCommands || !cmdMode)
-        && "mixing top level operands with commands");
-
+    auto & st = Config::state(*this);
+    st.arena.reset();
+    st.phaseEvents.clear();
     resetValues();
 
 #if !defined(DIMCLI_LIB_NO_ENV)
     // Insert environment options
     if (m_cfg->envOpts.size()) {
+        PhaseTimer timer(*this, kPhaseEnv);
         if (auto val = getenv(m_cfg->envOpts.c_str()))
             replace(args, 1, 0, toArgv(val));
     }
@@ -2437,54 +4160,82 @@ bool Cli::parse(vector<string> & args) {
     // Expand response files
 #ifdef DIMCLI_LIB_FILESYSTEM
     if (m_cfg->responseFiles) {
-        vector<string> ancestors;
-        if (!expandResponseFiles(*this, args, ancestors))
+        PhaseTimer timer(*this, kPhaseResponseFiles);
+        if (!expandResponseFiles(*this, args))
             return false;
     }
 #endif
 
     // Before actions
-    for (auto && fn : m_cfg->befores) {
-        if (!fn(*this, args))
-            return false;
+    if (!m_cfg->befores.empty()) {
+        PhaseTimer timer(*this, kPhaseBefore);
+        for (auto && fn : m_cfg->befores) {
+            if (!fn(*this, args))
+                return false;
+        }
     }
 
-    // Extract raw values and assign non-positional values to opts.
-    vector<RawValue> rawValues;
+    ArenaVec<const char *> argv(args.size(), st.arena);
+    for (size_t i = 0; i < args.size(); ++i)
+        argv[i] = args[i].c_str();
+    return parseArgs(argv.size(), argv.data());
+}
+
+//===========================================================================
+// Parses args that have already had environment options and response files
+// expanded. Values refer directly into argv, which must stay valid until it
+// returns.
+bool Cli::parseArgs(size_t argc, const char * const argv[]) {
+    auto & st = Config::state(*this);
+    PhaseTimer matchTimer(*this, kPhaseMatch);
+    auto * ndx = &Config::findIndex(*this, "");
+    enum {
+        kNone,
+        kPending,
+        kFound,
+        kUnknown
+    } cmdMode = m_cfg->allowUnknown || m_cfg->cmds.size() > 1
+        ? kPending
+        : kNone;
+
+    // Commands can't be added when the top level has an operand that requires
+    // look ahead to match, command processing requires that the command be
+    // unambiguously identifiable.
+    assert((ndx->m_allowCommands || !cmdMode)
+        && "mixing top level operands with commands");
 
-    auto arg = args.data();
-    auto argc = args.size();
+    // Extract raw values and assign non-positional values to opts. There's
+    // usually one value per arg, more only when short names are combined.
+    ArenaVec<RawValue> rawValues(st.arena);
+    rawValues.reserve(argc);
 
-    string name;
+    auto arg = argv;
     bool moreOpts = true;
     int numPos = 0;
     size_t precmdValues = 0;
-    m_cfg->progName = *arg;
+    st.progName = *arg;
     size_t argPos = 1;
     arg += 1;
 
     for (; argPos < argc; ++argPos, ++arg) {
-        OptName argName;
+        const OptName * argName;
         const char * equal = nullptr;
-        auto ptr = arg->c_str();
+        auto ptr = *arg;
         if (*ptr == '-' && ptr[1] && moreOpts) {
             ptr += 1;
             for (; *ptr && *ptr != '-'; ++ptr) {
-                auto it = ndx.m_shortNames.find(*ptr);
-                name = '-';
-                name += *ptr;
-                if (it == ndx.m_shortNames.end())
-                    return badUsage("Unknown option", name);
-                argName = it->second;
-                if (argName.opt->m_finalOpt)
+                argName = ndx->findShort(*ptr);
+                if (!argName)
+                    return badUsage("Unknown option", "-"s + *ptr);
+                if (argName->opt->m_finalOpt)
                     moreOpts = false;
-                if (argName.opt->m_bool) {
+                if (argName->opt->m_bool) {
                     rawValues.emplace_back(
                         RawValue::kOption,
-                        argName.opt,
-                        name,
+                        argName->opt,
+                        &argName->name,
                         argPos,
-                        argName.invert ? "0" : "1"
+                        argName->invert ? "0" : "1"
                     );
                     continue;
                 }
@@ -2500,36 +4251,35 @@ bool Cli::parse(vector<string> & args) {
                 moreOpts = false;
                 continue;
             }
-            string key;
+            size_t len;
             equal = strchr(ptr, '=');
             if (equal) {
-                key.assign(ptr, equal);
-                ptr = equal + 1;
+                len = equal - ptr;
             } else {
-                key = ptr;
-                ptr = "";
+                len = strlen(ptr);
             }
-            auto it = ndx.m_longNames.find(key);
-            name = "--";
-            name += key;
-            if (it == ndx.m_longNames.end())
-                return badUsage("Unknown option", name);
-            argName = it->second;
-            if (argName.opt->m_finalOpt)
+            argName = ndx->findLong(ptr, len);
+            if (!argName)
+                return badUsage("Unknown option", "--" + string(ptr, len));
+            ptr = equal ? equal + 1 : "";
+            if (argName->opt->m_finalOpt)
                 moreOpts = false;
-            if (argName.opt->m_bool) {
+            if (argName->opt->m_bool) {
                 auto val = true;
                 if (equal
-                    && (argName.opt->m_flagValue || !parseBool(val, ptr))
+                    && (argName->opt->m_flagValue || !parseBool(val, ptr))
                 ) {
-                    return badUsage("Invalid '" + name + "' value", ptr);
+                    return badUsage(
+                        "Invalid '" + argName->name + "' value",
+                        ptr
+                    );
                 }
                 rawValues.emplace_back(
                     RawValue::kOption,
-                    argName.opt,
-                    name,
+                    argName->opt,
+                    &argName->name,
                     argPos,
-                    argName.invert == val ? "0" : "1"
+                    argName->invert == val ? "0" : "1"
                 );
                 continue;
             }
@@ -2537,13 +4287,13 @@ bool Cli::parse(vector<string> & args) {
         }
 
         // Positional value
-        if (cmdMode == kPending && numPos == ndx.m_minOprs) {
-            auto cmd = (string) ptr;
+        if (cmdMode == kPending && numPos == ndx->m_minOprs) {
+            PhaseTimer timer(*this, kPhaseOperands);
             bool noExtras = assignOperands(
                 rawValues.data(),
                 rawValues.size(),
                 *this,
-                ndx,
+                *ndx,
                 numPos
             );
             // Number of assigned operands should always exactly match the
@@ -2553,34 +4303,42 @@ bool Cli::parse(vector<string> & args) {
                     "operand count mismatch");
             }
 
-            rawValues.emplace_back(RawValue::kCommand, nullptr, cmd);
+            rawValues.emplace_back(
+                RawValue::kCommand,
+                nullptr,
+                nullptr,
+                argPos,
+                ptr
+            );
             precmdValues = rawValues.size();
             numPos = 0;
+            timer.stop();
 
-            if (commandExists(cmd)) {
+            st.command = ptr;
+            if (commandExists(st.command)) {
                 cmdMode = kFound;
-                ndx.index(*this, cmd, false);
+                ndx = &Config::findIndex(*this, st.command);
             } else if (m_cfg->allowUnknown) {
                 cmdMode = kUnknown;
                 moreOpts = false;
             } else {
-                return badUsage("Unknown command", cmd);
+                st.command.clear();
+                return badUsage("Unknown command", ptr);
             }
-            m_cfg->command = cmd;
             continue;
         }
         if (cmdMode == kUnknown) {
-            m_cfg->unknownArgs.push_back(ptr);
+            st.unknownArgs.push_back(ptr);
             continue;
         }
 
-        if (numPos == ndx.m_finalOpr)
+        if (numPos == ndx->m_finalOpr)
             moreOpts = false;
 
         rawValues.emplace_back(
             RawValue::kOperand,
             nullptr,
-            string{},
+            nullptr,
             argPos,
             ptr
         );
@@ -2592,18 +4350,18 @@ bool Cli::parse(vector<string> & args) {
         if (*ptr || equal) {
             rawValues.emplace_back(
                 RawValue::kOption,
-                argName.opt,
-                name,
+                argName->opt,
+                &argName->name,
                 argPos,
                 ptr
             );
             continue;
         }
-        if (argName.optional) {
+        if (argName->optional) {
             rawValues.emplace_back(
                 RawValue::kOption,
-                argName.opt,
-                name,
+                argName->opt,
+                &argName->name,
                 argPos,
                 nullptr
             );
@@ -2612,44 +4370,78 @@ bool Cli::parse(vector<string> & args) {
         argPos += 1;
         arg += 1;
         if (argPos == argc)
-            return badUsage("No value given for " + name);
+            return badUsage("No value given for " + argName->name);
         rawValues.emplace_back(
             RawValue::kOption,
-            argName.opt,
-            name,
+            argName->opt,
+            &argName->name,
             argPos,
-            arg->c_str()
+            *arg
         );
     }
 
+    matchTimer.stop();
+
     if (cmdMode != kUnknown) {
+        PhaseTimer timer(*this, kPhaseOperands);
         if (!assignOperands(
             rawValues.data() + precmdValues,
             rawValues.size() - precmdValues,
             *this,
-            ndx,
+            *ndx,
             numPos
         )) {
             return false;
         }
     }
 
-    // Parse values and assign them to arguments.
-    m_cfg->command = "";
-    for (auto&& val : rawValues) {
-        switch (val.type) {
-        case RawValue::kCommand:
-            m_cfg->command = val.name;
+    // Parse values and assign them to arguments. Consecutive values of the
+    // same option and name are parsed by the option as a batch, unless the
+    // phases of each value are being timed.
+    st.command = "";
+    auto batch = !m_cfg->phaseTiming;
+    for (auto val = rawValues.begin(); val != rawValues.end();) {
+        if (val->type == RawValue::kCommand) {
+            st.command = val->ptr;
+            ++val;
             continue;
-        default:
-            break;
         }
-        if (!parseValue(*val.opt, val.name, val.pos, val.ptr))
-            return false;
+        auto last = val + 1;
+        if (batch) {
+            while (last != rawValues.end()
+                && last->type != RawValue::kCommand
+                && last->opt == val->opt
+                && last->name == val->name
+            ) {
+                ++last;
+            }
+        }
+        auto count = size_t(last - val);
+        if (count == 1) {
+            if (!parseValue(*val->opt, *val->name, val->pos, val->ptr))
+                return false;
+        } else {
+            ArenaVec<size_t> pos(count, st.arena);
+            ArenaVec<const char *> ptrs(count, st.arena);
+            for (size_t i = 0; i < count; ++i) {
+                pos[i] = val[i].pos;
+                ptrs[i] = val[i].ptr;
+            }
+            if (!val->opt->parseValues(
+                *this,
+                *val->name,
+                pos.data(),
+                ptrs.data(),
+                count
+            )) {
+                return false;
+            }
+        }
+        val = last;
     }
-
     // Report options with too few values.
-    for (auto&& argName : ndx.m_argNames) {
+    PhaseTimer checkTimer(*this, kPhaseCheck);
+    for (auto&& argName : ndx->m_argNames) {
         auto & opt = *argName.opt;
         if (!argName.optional) {
             // Report required operands that are missing.
@@ -2657,21 +4449,21 @@ bool Cli::parse(vector<string> & args) {
                 return badMinMatched(*this, opt, argName.name);
         }
     }
-    for (auto&& nv : ndx.m_shortNames) {
-        auto & opt = *nv.second.opt;
-        if (!nv.second.pos && opt && opt.size() < (size_t) opt.minSize())
-            return badMinMatched(*this, opt);
-    }
-    for (auto && nv : ndx.m_longNames) {
-        auto & opt = *nv.second.opt;
-        if (!nv.second.pos && opt && opt.size() < (size_t) opt.minSize())
+    for (auto && val : rawValues) {
+        if (val.type != RawValue::kOption)
+            continue;
+        auto & opt = *val.opt;
+        if (opt && opt.size() < (size_t) opt.minSize())
             return badMinMatched(*this, opt);
     }
 
+    checkTimer.stop();
+
     // After actions
     for (auto && opt : m_cfg->opts) {
         if (!opt->m_command.empty() && opt->m_command != commandMatched())
             continue;
+        PhaseTimer timer(*this, kPhaseAfter, opt);
         if (!opt->doAfterActions(*this))
             return false;
     }
@@ -2689,24 +4481,228 @@ bool Cli::parse(ostream & os, vector<string> & args) {
 
 //===========================================================================
 bool Cli::parse(vector<string> && args) {
+    if (auto ctx = Config::pendingContext(*this)) {
+        Context::Scope scope(*ctx);
+        return parse(move(args));
+    }
+
+    // The args belong to this parse, so string values are moved out of them
+    // instead of being copied.
+    struct OwnedArgs {
+        Context::State & st;
+        OwnedArgs(Context::State & st, vector<string> & args) : st(st) {
+            st.ownedArgs = &args;
+        }
+        ~OwnedArgs() { st.ownedArgs = nullptr; }
+    } owned(Config::state(*this), args);
     return parse(args);
 }
 
 //===========================================================================
 bool Cli::parse(ostream & os, vector<string> && args) {
-    return parse(os, args);
+    if (parse(move(args)))
+        return true;
+    printError(os);
+    return false;
 }
 
 //===========================================================================
 bool Cli::parse(size_t argc, char * argv[]) {
-    auto args = toArgv(argc, argv);
-    return parse(move(args));
+    // The 0th (name of this program) opt must always be present.
+    assert(argc && "at least one argument (the program name) required");
+    if (auto ctx = Config::pendingContext(*this)) {
+        Context::Scope scope(*ctx);
+        return parse(argc, argv);
+    }
+
+    // Parse directly from argv unless it has to be changed first, by having
+    // environment options or response files expanded, or because it's being
+    // passed to before actions.
+    bool expand = !m_cfg->befores.empty();
+#if !defined(DIMCLI_LIB_NO_ENV)
+    if (m_cfg->envOpts.size() && getenv(m_cfg->envOpts.c_str()))
+        expand = true;
+#endif
+#ifdef DIMCLI_LIB_FILESYSTEM
+    if (m_cfg->responseFiles) {
+        for (size_t i = 0; i < argc && !expand; ++i) {
+            if (*argv[i] == '@')
+                expand = true;
+        }
+    }
+#endif
+    if (expand) {
+        auto args = toArgv(argc, argv);
+        return parse(move(args));
+    }
+
+    auto & st = Config::state(*this);
+    st.arena.reset();
+    st.phaseEvents.clear();
+    resetValues();
+    return parseArgs(argc, argv);
 }
 
 //===========================================================================
 bool Cli::parse(ostream & os, size_t argc, char * argv[]) {
-    auto args = toArgv(argc, argv);
-    return parse(os, move(args));
+    if (parse(argc, argv))
+        return true;
+    printError(os);
+    return false;
+}
+
+//===========================================================================
+bool Cli::parse(Context & ctx, size_t argc, char * argv[]) {
+    Config::bind(*this, ctx);
+    Context::Scope scope(ctx);
+    return parse(argc, argv);
+}
+
+//===========================================================================
+bool Cli::parse(Context & ctx, vector<string> & args) {
+    Config::bind(*this, ctx);
+    Context::Scope scope(ctx);
+    return parse(args);
+}
+
+//===========================================================================
+bool Cli::parse(Context & ctx, vector<string> && args) {
+    Config::bind(*this, ctx);
+    Context::Scope scope(ctx);
+    return parse(move(args));
+}
+
+//===========================================================================
+Cli & Cli::freeze() & {
+    auto & cfg = *m_cfg;
+    if (cfg.frozen)
+        return *this;
+
+    // Build the indexes of all commands, starting with the top level so that
+    // the commands of all options are defined before they're listed.
+    Config::findIndex(*this, "");
+    vector<string> cmds;
+    for (auto && kv : cfg.cmds)
+        cmds.push_back(kv.first);
+    for (auto && cmd : cmds)
+        Config::findIndex(*this, cmd);
+
+    // Options of the same value share a proxy, and so also a slot.
+    unordered_map<const void *, size_t> slots;
+    for (auto && opt : cfg.opts) {
+        auto ib = slots.insert({opt->valueProxy(), slots.size()});
+        opt->m_slot = ib.first->second;
+    }
+    cfg.numSlots = slots.size();
+    cfg.frozen = true;
+    return *this;
+}
+
+//===========================================================================
+Cli && Cli::freeze() && {
+    return move(freeze());
+}
+
+//===========================================================================
+bool Cli::frozen() const {
+    return m_cfg->frozen;
+}
+
+//===========================================================================
+// Parses "count" lines, spread over the threads, with each thread claiming
+// batches of lines at a time and parsing them into a context of its own.
+// "argsFn" sets args to the arguments of a line. If anything throws, the
+// remaining lines are abandoned and the first exception is rethrown once
+// all the threads have stopped.
+static vector<Cli::ParseResult> parseMany(
+    Cli & cli,
+    size_t count,
+    unsigned threads,
+    const function<void(vector<string> & args, size_t index)> & argsFn,
+    const function<Cli::ParseManyFn> & fn
+) {
+    const size_t kBatch = 64;
+    vector<Cli::ParseResult> out(count);
+    if (!count)
+        return out;
+    cli.freeze();
+
+    atomic<size_t> next {0};
+    mutex mut;
+    exception_ptr error;
+    auto worker = [&]() {
+        try {
+            Cli::Context ctx;
+            vector<string> args;
+            for (;;) {
+                auto first = next.fetch_add(kBatch);
+                if (first >= count)
+                    break;
+                auto last = min(first + kBatch, count);
+                for (auto i = first; i < last; ++i) {
+                    argsFn(args, i);
+                    auto & res = out[i];
+                    res.parsed = cli.parse(ctx, move(args));
+                    res.exitCode = ctx.exitCode();
+                    res.errMsg = ctx.errMsg();
+                    res.command = ctx.commandMatched();
+                    if (fn)
+                        fn(i, ctx);
+                }
+            }
+        } catch (...) {
+            next = count;
+            lock_guard<mutex> lk{mut};
+            if (!error)
+                error = current_exception();
+        }
+    };
+
+    if (!threads)
+        threads = max(thread::hardware_concurrency(), 1u);
+    auto batches = (count + kBatch - 1) / kBatch;
+    if (threads > batches)
+        threads = (unsigned) batches;
+    vector<thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i)
+        pool.emplace_back(worker);
+    worker();
+    for (auto && th : pool)
+        th.join();
+    if (error)
+        rethrow_exception(error);
+    return out;
+}
+
+//===========================================================================
+vector<Cli::ParseResult> Cli::parseMany(
+    const vector<string> & cmdlines,
+    unsigned threads,
+    function<ParseManyFn> fn
+) {
+    return ::parseMany(
+        *this,
+        cmdlines.size(),
+        threads,
+        [&](auto & args, size_t index) { args = toArgv(cmdlines[index]); },
+        fn
+    );
+}
+
+//===========================================================================
+vector<Cli::ParseResult> Cli::parseMany(
+    const vector<vector<string>> & argvs,
+    unsigned threads,
+    function<ParseManyFn> fn
+) {
+    return ::parseMany(
+        *this,
+        argvs.size(),
+        threads,
+        [&](auto & args, size_t index) { args = argvs[index]; },
+        fn
+    );
 }
 
 
@@ -2718,36 +4714,40 @@ bool Cli::parse(ostream & os, size_t argc, char * argv[]) {
 
 //===========================================================================
 int Cli::exitCode() const {
-    return m_cfg->exitCode;
+    return Config::state(*this).exitCode;
 };
 
 //===========================================================================
 const string & Cli::errMsg() const {
-    return m_cfg->errMsg;
+    return Config::state(*this).errMsg;
 }
 
 //===========================================================================
 const string & Cli::errDetail() const {
-    return m_cfg->errDetail;
+    return Config::state(*this).errDetail;
 }
 
 //===========================================================================
 const string & Cli::progName() const {
-    return m_cfg->progName;
+    return Config::state(*this).progName;
 }
 
 //===========================================================================
 const string & Cli::commandMatched() const {
-    return m_cfg->command;
+    return Config::state(*this).command;
 }
 
 //===========================================================================
 const vector<string> & Cli::unknownArgs() const {
-    return m_cfg->unknownArgs;
+    return Config::state(*this).unknownArgs;
 }
 
 //===========================================================================
 int Cli::exec() {
+    if (auto ctx = Config::pendingContext(*this)) {
+        Context::Scope scope(*ctx);
+        return exec();
+    }
     auto & name = commandMatched();
     auto cmdFn = commandExists(name)
         ? m_cfg->cmds[name].action
@@ -2755,6 +4755,7 @@ int Cli::exec() {
 
     if (cmdFn) {
         fail(kExitOk, {});
+        PhaseTimer timer(*this, kPhaseCommand);
         cmdFn(*this);
     } else {
         // Most likely parse failed, was never run, or "this" was reset.
@@ -2795,6 +4796,12 @@ int Cli::exec(ostream & os, vector<string> & args) {
     return printError(os);
 }
 
+//===========================================================================
+int Cli::exec(Context & ctx) {
+    Context::Scope scope(ctx);
+    return exec();
+}
+
 //===========================================================================
 bool Cli::commandExists(const string & name) const {
     auto & cmds = m_cfg->cmds;
@@ -2802,6 +4809,211 @@ bool Cli::commandExists(const string & name) const {
 }
 
 
+/****************************************************************************
+*
+*   Footprint
+*
+***/
+
+//===========================================================================
+Cli::Footprint & Cli::Footprint::operator+=(const Footprint & from) {
+    bytes += from.bytes;
+    allocs += from.allocs;
+    return *this;
+}
+
+//===========================================================================
+void Cli::Footprint::add(const string & val) {
+    // Short strings are kept in the small string buffer of the object.
+    static const auto s_inline = string().capacity();
+    if (val.capacity() > s_inline) {
+        bytes += val.capacity() + 1;
+        allocs += 1;
+    }
+}
+
+//===========================================================================
+Cli::Footprint Cli::MemoryStats::total() const {
+    auto out = options;
+    out += help;
+    out += commands;
+    out += indexes;
+    out += parse;
+    return out;
+}
+
+//===========================================================================
+void Cli::OptIndex::addFootprint(Footprint & out) const {
+    out.add(m_shortNames);
+    for (auto && sn : m_shortNames)
+        out.add(sn.second.name);
+    out.add(m_longNames);
+    for (auto && ln : m_longNames) {
+        out.add(ln.first);
+        out.add(ln.second.name);
+    }
+    out.add(m_argNames);
+    for (auto && an : m_argNames)
+        out.add(an.name);
+    out.add(m_longSeeds);
+    out.add(m_longSlots);
+    out.add(m_longSorted);
+}
+
+//===========================================================================
+static void addGroups(
+    Cli::MemoryStats & out,
+    const unordered_map<string, GroupConfig> & grps
+) {
+    addNodes(out.commands, grps);
+    for (auto && kv : grps) {
+        out.commands.add(kv.first);
+        out.commands.add(kv.second.name);
+        out.commands.add(kv.second.sortKey);
+        out.help.add(kv.second.title);
+    }
+}
+
+//===========================================================================
+Cli::MemoryStats Cli::memoryStats() const {
+    MemoryStats out;
+    auto & cfg = *m_cfg;
+
+    // The config itself, allocated along with its shared_ptr control block.
+    out.commands.bytes += sizeof(cfg) + 2 * sizeof(long);
+    out.commands.allocs += 1;
+    out.commands.add(cfg.befores);
+    out.commands.add(cfg.envOpts);
+    addGroups(out, cfg.cmdGroups);
+    addNodes(out.commands, cfg.cmds);
+    for (auto && kv : cfg.cmds) {
+        auto & cmd = kv.second;
+        out.cmds += 1;
+        out.groups += cmd.groups.size();
+        out.commands.add(kv.first);
+        out.commands.add(cmd.name);
+        out.commands.add(cmd.cmdGroup);
+        out.help.add(cmd.header);
+        out.help.add(cmd.desc);
+        out.help.add(cmd.footer);
+        addGroups(out, cmd.groups);
+    }
+
+    // The options and proxies count their own bytes, but not the blocks of
+    // the slab that they share.
+    Footprint slab;
+    cfg.slab.addFootprint(slab);
+    out.options.allocs += slab.allocs;
+    out.options.add(cfg.opts);
+    for (auto && opt : cfg.opts) {
+        out.opts += 1;
+        opt->addFootprint(out);
+    }
+
+    addNodes(out.indexes, cfg.optsByValue);
+    addNodes(out.indexes, cfg.ndxs);
+    for (auto && kv : cfg.ndxs) {
+        out.indexes.add(kv.first);
+        kv.second.addFootprint(out.indexes);
+    }
+
+    auto & st = Config::state(*this);
+    out.parse.add(st.errMsg);
+    out.parse.add(st.errDetail);
+    out.parse.add(st.progName);
+    out.parse.add(st.command);
+    out.parse.add(st.unknownArgs);
+    out.parse.add(st.phaseEvents);
+    st.arena.addFootprint(out.parse);
+    return out;
+}
+
+
+/****************************************************************************
+*
+*   Phase timing
+*
+***/
+
+//===========================================================================
+// static
+const char * Cli::phaseName(Phase phase) {
+    switch (phase) {
+    case kPhaseEnv: return "env";
+    case kPhaseResponseFiles: return "response files";
+    case kPhaseBefore: return "before";
+    case kPhaseMatch: return "match";
+    case kPhaseOperands: return "operands";
+    case kPhaseParse: return "parse";
+    case kPhaseCheck: return "check";
+    case kPhaseAfter: return "after";
+    case kPhaseCommand: return "command";
+    case kPhases: break;
+    }
+    return "unknown";
+}
+
+//===========================================================================
+const vector<Cli::PhaseEvent> & Cli::phaseEvents() const {
+    return Config::state(*this).phaseEvents;
+}
+
+//===========================================================================
+steady_clock::duration Cli::phaseTime(Phase phase) const {
+    steady_clock::duration out {};
+    for (auto && ev : Config::state(*this).phaseEvents) {
+        if (ev.phase == phase)
+            out += ev.duration;
+    }
+    return out;
+}
+
+//===========================================================================
+static void writeJsonString(ostream & os, const string & val) {
+    os << '"';
+    for (auto ch : val) {
+        if (ch == '"' || ch == '\\') {
+            os << '\\' << ch;
+        } else if ((unsigned char) ch < ' ') {
+            os << "\\u00" << "0123456789abcdef"[ch >> 4]
+                << "0123456789abcdef"[ch & 0xf];
+        } else {
+            os << ch;
+        }
+    }
+    os << '"';
+}
+
+//===========================================================================
+void Cli::writeTrace(ostream & os) const {
+    auto & events = Config::state(*this).phaseEvents;
+    auto base = events.empty() ? steady_clock::time_point{} : events[0].start;
+
+    // Timestamps are in microseconds, formatted independent of the locale
+    // of os.
+    ostringstream tmp;
+    tmp.imbue(locale::classic());
+    tmp << fixed << setprecision(3) << "{\"traceEvents\": [";
+    for (auto && ev : events) {
+        tmp << (&ev == events.data() ? "\n" : ",\n")
+            << "{\"name\": \"" << phaseName(ev.phase) << "\""
+            << ", \"cat\": \"dimcli\", \"ph\": \"X\""
+            << ", \"ts\": "
+            << duration<double, micro>(ev.start - base).count()
+            << ", \"dur\": " << duration<double, micro>(ev.duration).count()
+            << ", \"pid\": 1, \"tid\": 1";
+        if (ev.opt) {
+            tmp << ", \"args\": {\"opt\": ";
+            writeJsonString(tmp, ev.opt->defaultFrom());
+            tmp << "}";
+        }
+        tmp << "}";
+    }
+    tmp << "\n], \"displayTimeUnit\": \"ns\"}\n";
+    os << tmp.str();
+}
+
+
 /****************************************************************************
 *
 *   Help Text
@@ -125,12 +125,14 @@
 ***/
 
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <functional>
 #include <limits>
 #include <list>
 #include <memory>
+#include <new>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -192,6 +194,7 @@ enum {
 class DIMCLI_LIB_DECL Cli {
 public:
     struct Config;
+    class Context;
     class Convert;
 
     class OptBase;
@@ -201,6 +204,11 @@ public:
     struct OptIndex;
 
     struct ArgMatch;
+    struct Footprint;
+    struct MemoryStats;
+    struct ParseResult;
+    struct PhaseEvent;
+    class ResponseFileCache;
     template <typename T> struct Value;
     template <typename T> struct ValueVec;
 
@@ -419,6 +427,34 @@ public:
     Cli & responseFiles(bool enable = true) &;
     Cli && responseFiles(bool enable = true) &&;
 
+    // None by default, keeps the args of response files in the cache so
+    // that they're only read and tokenized again after the file changes.
+    // The same cache can be used by any number of clis and threads, null
+    // stops using one.
+    Cli & responseFileCache(std::shared_ptr<ResponseFileCache> cache) &;
+    Cli && responseFileCache(std::shared_ptr<ResponseFileCache> cache) &&;
+
+    // Defaults to 1, the number of threads used to read and tokenize the
+    // response files given directly on the command line. With more than
+    // one they're all loaded at once before being expanded, in order, with
+    // the same results and errors. Zero uses one per hardware thread.
+    Cli & responseFileThreads(unsigned threads) &;
+    Cli && responseFileThreads(unsigned threads) &&;
+
+    // Disabled by default, records the time parse() and exec() spend in each
+    // phase of processing, see cli.phaseEvents().
+    Cli & phaseTiming(bool enable = true) &;
+    Cli && phaseTiming(bool enable = true) &&;
+
+    // Disabled by default, makes parse() reset options when they're next
+    // used instead of all at once when it starts, so that reparsing costs
+    // depend on the arguments given rather than on the number of options.
+    // Options bound to external variables are still reset by every parse,
+    // so the variables are always current. Takes effect with the next
+    // parse and doesn't apply to parsing into a Cli::Context.
+    Cli & lazyReset(bool enable = true) &;
+    Cli && lazyReset(bool enable = true) &&;
+
     // Changes the streams used for prompting, printing help messages, etc.
     // Mainly intended for testing. Setting to null restores the defaults
     // which are cin and cout respectively.
@@ -488,12 +524,52 @@ public:
         std::ostream & oerr,
         std::vector<std::string> & args
     );
+
+    // When args are passed by rvalue, values of string options that have no
+    // parse or check actions are moved out of them instead of being copied.
     [[nodiscard]] bool parse(std::vector<std::string> && args);
     [[nodiscard]] bool parse(
         std::ostream & oerr,
         std::vector<std::string> && args
     );
 
+    // Parse into the context instead of into the options. Requires that the
+    // cli be frozen, and then any number of threads can parse at once, each
+    // into its own context. See Cli::Context for how the results are read.
+    [[nodiscard]] bool parse(Context & ctx, size_t argc, char * argv[]);
+    [[nodiscard]] bool parse(Context & ctx, std::vector<std::string> & args);
+    [[nodiscard]] bool parse(Context & ctx, std::vector<std::string> && args);
+
+    // Builds the indexes of all commands and prevents further changes to the
+    // definition, so it can be shared by concurrent parses. Adding options
+    // or changing how they're matched after freezing is an error.
+    Cli & freeze() &;
+    Cli && freeze() &&;
+    bool frozen() const;
+
+    // Parses each of the command lines, or pre-split argument vectors, into
+    // its own context and returns the results in the same order. The lines
+    // are spread over "threads" threads, or one per hardware thread if it's
+    // 0. Freezes the cli if it isn't already.
+    //
+    // If present, "fn" is called on the parsing thread with the position of
+    // each line and the context it was parsed into. This is the place to pull
+    // values out of the context, which is reused for the next line.
+    //
+    // An exception thrown while parsing, by an action or by "fn", stops the
+    // remaining lines from being parsed and is rethrown to the caller.
+    using ParseManyFn = void(size_t index, Context & ctx);
+    std::vector<ParseResult> parseMany(
+        const std::vector<std::string> & cmdlines,
+        unsigned threads = 0,
+        std::function<ParseManyFn> fn = {}
+    );
+    std::vector<ParseResult> parseMany(
+        const std::vector<std::vector<std::string>> & argvs,
+        unsigned threads = 0,
+        std::function<ParseManyFn> fn = {}
+    );
+
     // Sets all options to their defaults, called internally when parsing
     // starts.
     Cli & resetValues() &;
@@ -667,6 +743,10 @@ public:
     int exec(std::vector<std::string> & args);
     int exec(std::ostream & oerr, std::vector<std::string> & args);
 
+    // Executes the action of the command matched by a parse into ctx, with
+    // ctx active so the action sees its values.
+    int exec(Context & ctx);
+
     // Sets exitCode(), errMsg(), errDetail(), and returns false. Intended to
     // be called from command actions, parsing related failures should use
     // badUsage() instead.
@@ -681,6 +761,49 @@ public:
     // and had a chance to update the internal data structures.
     bool commandExists(const std::string & name) const;
 
+    //-----------------------------------------------------------------------
+    // FOOTPRINT
+    //
+    // Estimated heap memory held by the configuration, derived from the
+    // sizes and capacities of its strings and containers. Memory owned by
+    // the targets of std::function objects, by locales, and by values other
+    // than strings and vectors isn't included.
+
+    MemoryStats memoryStats() const;
+
+    //-----------------------------------------------------------------------
+    // PHASE TIMING
+    //
+    // Only recorded when enabled by cli.phaseTiming(). Events never overlap,
+    // when one phase runs another, such as an after action that prompts for
+    // a value and so runs parse and check actions, the outer phase is split
+    // in two with the inner phase between them.
+
+    enum Phase {
+        kPhaseEnv,              // inserting environment options
+        kPhaseResponseFiles,    // expanding response files
+        kPhaseBefore,           // before actions
+        kPhaseMatch,            // tokenizing and matching option names
+        kPhaseOperands,         // assigning operands
+        kPhaseParse,            // parse actions (value conversion)
+        kPhaseCheck,            // check actions and required value counts
+        kPhaseAfter,            // after actions
+        kPhaseCommand,          // command action run by exec()
+        kPhases
+    };
+    static const char * phaseName(Phase phase);
+
+    // Events recorded by the last parse() and any exec() after it, in the
+    // order they happened.
+    const std::vector<PhaseEvent> & phaseEvents() const;
+
+    // Total time of phase in the recorded events.
+    std::chrono::steady_clock::duration phaseTime(Phase phase) const;
+
+    // Writes the recorded events as Chrome trace event JSON, which can be
+    // loaded by chrome://tracing, Perfetto, and similar tools.
+    void writeTrace(std::ostream & os) const;
+
     //-----------------------------------------------------------------------
     // RENDERING ARBITRARY TEXT
     //
@@ -810,14 +933,28 @@ private:
         OptBase & opt,
         const std::string & val
     );
+    static bool badParse(Cli & cli, OptBase & opt, const std::string & val);
+
+    // Argument of the parse in progress that holds exactly the value at
+    // 'ptr' and can be moved from, because the args were passed by rvalue,
+    // otherwise null.
+    std::string * ownedArg(size_t pos, const char ptr[]);
 
     static std::vector<std::pair<std::string, double>> siUnitMapping(
         const std::string & symbol,
         int flags
     );
 
-    void addOpt(std::unique_ptr<OptBase> opt);
-    template <typename A> A & addOpt(std::unique_ptr<A> ptr);
+    // Options and their value proxies are placed in memory that belongs to
+    // the config, and is only released when the config is destroyed.
+    template <typename T> struct SlabAlloc;
+    static void * allocSlab(Config & cfg, size_t bytes, size_t align);
+
+    void addOpt(OptBase * opt);
+    template <typename A, typename V>
+    A & addOpt(std::shared_ptr<V> proxy, const std::string & names);
+
+    bool parseArgs(size_t argc, const char * const argv[]);
 
     template <typename A, typename V, typename T>
     std::shared_ptr<V> getProxy(T * ptr);
@@ -826,6 +963,7 @@ private:
     OptBase * findOpt(const void * value);
 
     std::shared_ptr<Config> m_cfg;
+    std::shared_ptr<Context> m_ctx; // only set for clones
     std::string m_group;
     std::string m_command;
 };
@@ -838,9 +976,7 @@ Cli::Opt<T> & Cli::opt(
     const U & def
 ) {
     auto proxy = getProxy<Opt<T>, Value<T>>(value);
-    auto ptr = std::make_unique<Opt<T>>(proxy, names);
-    ptr->defaultValue(def);
-    return addOpt(std::move(ptr));
+    return addOpt<Opt<T>>(proxy, names).defaultValue(def);
 }
 
 //===========================================================================
@@ -856,8 +992,7 @@ Cli::OptVec<T> & Cli::optVec(
     const std::string & names
 ) {
     auto proxy = getProxy<OptVec<T>, ValueVec<T>>(values);
-    auto ptr = std::make_unique<OptVec<T>>(proxy, names);
-    return addOpt(std::move(ptr));
+    return addOpt<OptVec<T>>(proxy, names);
 }
 
 //===========================================================================
@@ -912,12 +1047,38 @@ bool Cli::badRange(
 }
 
 //===========================================================================
-template <typename A>
-A & Cli::addOpt(std::unique_ptr<A> ptr) {
-    auto & opt = *ptr;
-    opt.parse(&Cli::defParseAction).command(command()).group(group());
-    addOpt(std::unique_ptr<OptBase>(ptr.release()));
-    return opt;
+template <typename T>
+struct Cli::SlabAlloc {
+    using value_type = T;
+
+    Config * cfg;
+
+    SlabAlloc(Config & cfg) : cfg(&cfg) {}
+    template <typename U>
+    SlabAlloc(const SlabAlloc<U> & from) : cfg(from.cfg) {}
+
+    T * allocate(size_t num) {
+        return static_cast<T *>(allocSlab(*cfg, num * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const SlabAlloc<U> & other) const {
+        return cfg == other.cfg;
+    }
+    template <typename U>
+    bool operator!=(const SlabAlloc<U> & other) const {
+        return cfg != other.cfg;
+    }
+};
+
+//===========================================================================
+template <typename A, typename V>
+A & Cli::addOpt(std::shared_ptr<V> proxy, const std::string & names) {
+    auto ptr = new (allocSlab(*m_cfg, sizeof(A), alignof(A))) A(proxy, names);
+    ptr->command(command()).group(group());
+    addOpt(static_cast<OptBase *>(ptr));
+    return *ptr;
 }
 
 //===========================================================================
@@ -929,7 +1090,7 @@ std::shared_ptr<V> Cli::getProxy(T * ptr) {
     }
 
     // Since there was no existing proxy to the raw value, create one.
-    return std::make_shared<V>(ptr);
+    return std::allocate_shared<V>(SlabAlloc<V>(*m_cfg), ptr);
 }
 
 //===========================================================================
@@ -971,6 +1132,108 @@ std::string Cli::valueDesc<DIMCLI_LIB_FILESYSTEM_PATH>() {
 class DIMCLI_LIB_DECL CliLocal : public Cli {
 public:
     CliLocal();
+
+    // Creates a cli that shares the definition, which is frozen if it isn't
+    // already, but parses into its own option values and results. Doesn't
+    // copy anything up front, values are created the first time the clone
+    // uses them.
+    //
+    // The clone's values are seen by its actions, and anywhere else within
+    // a Cli::Context::Scope of its context().
+    CliLocal clone();
+
+    // Context the clone parses into, or null if this cli isn't a clone.
+    Context * context() const;
+
+private:
+    explicit CliLocal(const Cli & from);
+};
+
+
+/****************************************************************************
+*
+*   Cli::Footprint
+*
+*   Estimated heap memory, see cli.memoryStats()
+*
+***/
+
+struct Cli::Footprint {
+    size_t bytes {};    // bytes allocated
+    size_t allocs {};   // number of allocations the bytes are spread over
+
+    Footprint & operator+=(const Footprint & from);
+
+    // Adds the heap buffer of strings too long for the small string buffer.
+    void add(const std::string & val);
+
+    // Adds the buffer of the vector and whatever its members own.
+    template <typename T>
+    void add(const std::vector<T> & vals);
+
+    // Values of other types are assumed to own no memory.
+    template <typename T>
+    void add(const T &) {}
+};
+
+//===========================================================================
+template <typename T>
+inline void Cli::Footprint::add(const std::vector<T> & vals) {
+    if (vals.capacity()) {
+        bytes += vals.capacity() * sizeof(T);
+        allocs += 1;
+    }
+    for (auto && val : vals)
+        add(val);
+}
+
+struct Cli::MemoryStats {
+    size_t opts {};
+    size_t cmds {};
+    size_t groups {};   // option groups, summed over all commands
+
+    Footprint options;  // options, their names, actions, and internal values
+    Footprint help;     // descriptions, headers, footers, and titles
+    Footprint commands; // commands, groups, and other settings
+    Footprint indexes;  // option name indexes cached by parse()
+    Footprint parse;    // results and scratch memory of the last parse
+
+    Footprint total() const;
+};
+
+
+/****************************************************************************
+*
+*   Cli::ParseResult
+*
+*   Outcome of parsing one of the command lines, see cli.parseMany()
+*
+***/
+
+struct Cli::ParseResult {
+    bool parsed {}; // what parse() returned
+    int exitCode {};
+    std::string errMsg;
+    std::string command;
+};
+
+
+/****************************************************************************
+*
+*   Cli::PhaseEvent
+*
+*   Time spent in a phase of parse() or exec(), see cli.phaseEvents()
+*
+***/
+
+struct Cli::PhaseEvent {
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::duration duration;
+
+    // Option whose action was running, null for phases not tied to one.
+    // Only valid as long as the option is.
+    const OptBase * opt;
 };
 
 
@@ -994,9 +1257,60 @@ public:
     [[nodiscard]] bool toString(std::string & out, const T & src) const;
 
 protected:
-    mutable std::stringstream m_interpreter;
+    // Stream for iostream based conversions. Streams are expensive to create,
+    // so instead of each converter having its own they're borrowed from a
+    // per thread pool for the duration of a single conversion.
+    class DIMCLI_LIB_DECL Interpreter {
+    public:
+        explicit Interpreter(const std::locale & loc);
+        ~Interpreter();
+        Interpreter(const Interpreter &) = delete;
+        Interpreter & operator=(const Interpreter &) = delete;
+
+        std::stringstream & operator*() const { return *m_strm; }
+        std::stringstream * operator->() const { return m_strm.get(); }
+
+    private:
+        std::unique_ptr<std::stringstream> m_strm;
+    };
+
+    // Locale used for conversions.
+    const std::locale & getLocale() const;
+
+    // Locale used for conversions, unless m_preferredLocale is set. In which
+    // case the user's preferred locale (aka locale("")) is used, it's
+    // created on first use and shared by all converters.
+    std::locale m_locale;
+    bool m_preferredLocale {};
+
+    // Converts to the shortest string that converts back to the same value.
+    bool toRoundTripString(std::string & out, long double src) const;
 
 private:
+    // Arithmetic types that are converted as numbers, as opposed to bool and
+    // the character types.
+    template <typename T>
+    struct IsNumber : std::integral_constant<bool,
+        std::is_arithmetic<T>::value
+        && !std::is_same<T, bool>::value
+        && !std::is_same<T, char>::value
+        && !std::is_same<T, signed char>::value
+        && !std::is_same<T, unsigned char>::value
+        && !std::is_same<T, wchar_t>::value
+        && !std::is_same<T, char16_t>::value
+        && !std::is_same<T, char32_t>::value
+#if defined(__cpp_char8_t)
+        && !std::is_same<T, char8_t>::value
+#endif
+    > {};
+
+    // Result of converting a number without using iostreams.
+    enum class NumParse {
+        kValid,
+        kInvalid,
+        kUseStream, // locale or value requires conversion via iostreams
+    };
+
     template <typename T>
     auto fromString_impl(T & out, const std::string & src, int, int, int) const
         -> decltype(out = src, bool());
@@ -1009,6 +1323,13 @@ private:
         int, int, long
     ) const;
 
+    template <typename T>
+    auto fromString_impl(
+        T & out,
+        const std::string & src,
+        int, int, long
+    ) const -> typename std::enable_if<IsNumber<T>::value, bool>::type;
+
     template <typename T>
     auto fromString_impl(
         T & out,
@@ -1024,11 +1345,43 @@ private:
     ) const;
 
     template <typename T>
-    auto toString_impl(std::string & out, const T & src, int) const
+    bool fromNumber(T & out, const std::string & src, std::true_type) const;
+    template <typename T>
+    bool fromNumber(T & out, const std::string & src, std::false_type) const;
+    template <typename T>
+    bool fromStream(T & out, const std::string & src) const;
+
+    // Integers are returned as the magnitude and whether it was negative.
+    NumParse parseNumber(
+        bool & neg,
+        unsigned long long & out,
+        const std::string & src
+    ) const;
+    NumParse parseNumber(float & out, const std::string & src) const;
+    NumParse parseNumber(double & out, const std::string & src) const;
+    NumParse parseNumber(long double & out, const std::string & src) const;
+    template <typename T>
+    NumParse parseFloat(T & out, const std::string & src) const;
+
+    template <typename T>
+    auto toString_impl(std::string & out, const T & src, int, int) const
+        -> typename std::enable_if<IsNumber<T>::value, bool>::type;
+
+    template <typename T>
+    auto toString_impl(std::string & out, const T & src, int, long) const
         -> decltype(std::declval<std::ostream &>() << src, bool());
 
     template <typename T>
-    bool toString_impl(std::string & out, const T & src, long) const;
+    bool toString_impl(std::string & out, const T & src, long, long) const;
+
+    template <typename T>
+    bool toStream(std::string & out, const T & src) const;
+
+    // Return false if the number must be converted via iostreams.
+    bool formatNumber(std::string & out, long long src) const;
+    bool formatNumber(std::string & out, unsigned long long src) const;
+    bool formatNumber(std::string & out, double src) const;
+    bool formatNumber(std::string & out, long double src) const;
 };
 
 //===========================================================================
@@ -1068,6 +1421,18 @@ bool Cli::Convert::fromString_impl(
     return true;
 }
 
+//===========================================================================
+template <typename T>
+auto Cli::Convert::fromString_impl(
+    T & out,
+    const std::string & src,
+    int, int, long
+) const
+    -> typename std::enable_if<IsNumber<T>::value, bool>::type
+{
+    return fromNumber(out, src, std::is_integral<T>());
+}
+
 //===========================================================================
 template <typename T>
 auto Cli::Convert::fromString_impl(
@@ -1077,13 +1442,7 @@ auto Cli::Convert::fromString_impl(
 ) const
     -> decltype(std::declval<std::istream &>() >> out, bool())
 {
-    m_interpreter.clear();
-    m_interpreter.str(src);
-    if (!(m_interpreter >> out) || !(m_interpreter >> std::ws).eof()) {
-        out = {};
-        return false;
-    }
-    return true;
+    return fromStream(out, src);
 }
 
 //===========================================================================
@@ -1106,13 +1465,75 @@ bool Cli::Convert::fromString_impl(
     return false;
 }
 
+//===========================================================================
+// Integral number
+template <typename T>
+bool Cli::Convert::fromNumber(
+    T & out,
+    const std::string & src,
+    std::true_type
+) const {
+    bool neg = false;
+    unsigned long long num = 0;
+    auto res = parseNumber(neg, num, src);
+    if (res == NumParse::kUseStream)
+        return fromStream(out, src);
+    if (res == NumParse::kValid) {
+        auto high = (unsigned long long) std::numeric_limits<T>::max();
+        if (std::is_signed<T>::value) {
+            // Allow for the magnitude of the most negative value.
+            if (num <= high + neg) {
+                out = !neg ? (T) num
+                    : !num ? (T) 0
+                    : (T) (-(long long) (num - 1) - 1);
+                return true;
+            }
+        } else if (num <= high) {
+            // Negative unsigned values wrap around, the same as strtoul.
+            out = neg ? (T) (0 - num) : (T) num;
+            return true;
+        }
+    }
+    out = {};
+    return false;
+}
+
+//===========================================================================
+// Floating point number
+template <typename T>
+bool Cli::Convert::fromNumber(
+    T & out,
+    const std::string & src,
+    std::false_type
+) const {
+    auto res = parseNumber(out, src);
+    if (res == NumParse::kUseStream)
+        return fromStream(out, src);
+    if (res == NumParse::kValid)
+        return true;
+    out = {};
+    return false;
+}
+
+//===========================================================================
+template <typename T>
+bool Cli::Convert::fromStream(T & out, const std::string & src) const {
+    Interpreter strm(getLocale());
+    strm->str(src);
+    if (!(*strm >> out) || !(*strm >> std::ws).eof()) {
+        out = {};
+        return false;
+    }
+    return true;
+}
+
 //===========================================================================
 template <typename T>
 [[nodiscard]] bool Cli::Convert::toString(
     std::string & out,
     const T & src
 ) const {
-    return toString_impl(out, src, 0);
+    return toString_impl(out, src, 0, 0);
 }
 
 //===========================================================================
@@ -1120,18 +1541,40 @@ template <typename T>
 auto Cli::Convert::toString_impl(
     std::string & out,
     const T & src,
-    int
+    int, int
+) const
+    -> typename std::enable_if<IsNumber<T>::value, bool>::type
+{
+    // Widen to the largest type of the same kind, except for float which is
+    // formatted as a double, the same as ostream does.
+    using Num = typename std::conditional<
+        std::is_integral<T>::value,
+        typename std::conditional<
+            std::is_signed<T>::value,
+            long long,
+            unsigned long long
+        >::type,
+        typename std::conditional<
+            std::is_same<T, long double>::value,
+            long double,
+            double
+        >::type
+    >::type;
+    if (formatNumber(out, (Num) src))
+        return true;
+    return toStream(out, src);
+}
+
+//===========================================================================
+template <typename T>
+auto Cli::Convert::toString_impl(
+    std::string & out,
+    const T & src,
+    int, long
 ) const
     -> decltype(std::declval<std::ostream &>() << src, bool())
 {
-    m_interpreter.clear();
-    m_interpreter.str({});
-    if (!(m_interpreter << src)) {
-        out.clear();
-        return false;
-    }
-    out = m_interpreter.str();
-    return true;
+    return toStream(out, src);
 }
 
 //===========================================================================
@@ -1139,12 +1582,24 @@ template <typename T>
 bool Cli::Convert::toString_impl(
     std::string & out,
     const T &,
-    long
+    long, long
 ) const {
     out.clear();
     return false;
 }
 
+//===========================================================================
+template <typename T>
+bool Cli::Convert::toStream(std::string & out, const T & src) const {
+    Interpreter strm(getLocale());
+    if (!(*strm << src)) {
+        out.clear();
+        return false;
+    }
+    out = strm->str();
+    return true;
+}
+
 
 /****************************************************************************
 *
@@ -1246,6 +1701,9 @@ public:
     const std::string & command() const { return m_command; }
     const std::string & group() const { return m_group; }
 
+    // Estimated heap memory of the option, its help text included.
+    Footprint footprint() const;
+
     //-----------------------------------------------------------------------
     // UPDATE VALUE
 
@@ -1262,7 +1720,24 @@ protected:
 
     virtual bool doParseAction(Cli & cli, const std::string & value) = 0;
     virtual bool doCheckActions(Cli & cli, const std::string & value) = 0;
+
+    // Moves the string into the value if it's used as is, without being
+    // converted or passed to parse or check actions. Otherwise returns false
+    // and the string is left to be parsed.
+    virtual bool takeValue(std::string & value) = 0;
     virtual bool doAfterActions(Cli & cli) = 0;
+
+    // Parses values given to the option by consecutive arguments of the same
+    // name, the same as calling cli.parseValue() for each in turn. Stops and
+    // returns false at the first failure.
+    virtual bool parseValues(
+        Cli & cli,
+        const std::string & name,
+        const size_t pos[],
+        const char * const ptrs[],
+        size_t count
+    ) = 0;
+
     virtual bool assign(const std::string & name, size_t pos) = 0;
     virtual bool assigned() const = 0;
 
@@ -1274,12 +1749,37 @@ protected:
     // True for flags (bool on command line) that default to true.
     virtual bool inverted() const = 0;
 
-    // Allows the type unaware layer to determine if a new option is pointing
-    // at the same value as an existing option -- with RTTI disabled
-    virtual bool sameValue(const void * value) const = 0;
+    // True if the value is a variable outside of the option, rather than
+    // internal to it.
+    virtual bool externalValue() const = 0;
+
+    // Address of the value the option updates, allows the type unaware layer
+    // to determine if a new option is pointing at the same value as an
+    // existing option -- with RTTI disabled
+    virtual const void * valueAddress() const = 0;
+
+    // Proxy of the value, shared by all options of the same value, and a new
+    // proxy with its own internal value for use by a Cli::Context.
+    virtual const void * valueProxy() const = 0;
+    virtual std::shared_ptr<void> newValueProxy() const = 0;
+
+    // Proxy from the context active on this thread, or null if there isn't
+    // one, it's for another cli, or the cli isn't frozen.
+    void * contextProxy() const {
+        return m_slot == kNoSlot ? nullptr : findContextProxy();
+    }
+    void * findContextProxy() const;
+
+    // Adds memory of the option to the options and help totals.
+    virtual void addFootprint(MemoryStats & out) const;
 
     void setNameIfEmpty(const std::string & name);
 
+    // Called by modifiers that change how the option is indexed (names,
+    // command, arity, etc), so the cli rebuilds its cached indexes before
+    // the next parse.
+    void touchDefinition();
+
     bool withUnits(
         long double & out,
         Cli & cli,
@@ -1319,6 +1819,18 @@ private:
 
     std::string m_names;
     std::string m_fromName;
+
+    // Config that owns this option, null until the option has been added to
+    // one, and the position of its value in the contexts of that config,
+    // assigned when it's frozen.
+    static const size_t kNoSlot = (size_t) -1;
+    Config * m_owner {};
+    size_t m_slot {kNoSlot};
+
+protected:
+    // Parse generation of the config when lazy reset is enabled, values
+    // last reset in an older generation are reset before they're used.
+    const unsigned * m_generation {};
 };
 
 
@@ -1467,7 +1979,7 @@ public:
     // If you just need support for a new type you can provide a istream
     // extraction (>>) or assignment from string operator and the default
     // parse action will pick it up.
-    A & parse(std::function<ActionFn> fn);
+    template <typename F> A & parse(F && fn);
 
     // Action to take immediately after each value is parsed, unlike parsing
     // itself where there can only be one action, any number of check actions
@@ -1482,7 +1994,7 @@ public:
     //    processing continue.
     //
     // The opt is fully populated so *opt, opt.from(), etc are all available.
-    A & check(std::function<ActionFn> fn);
+    template <typename F> A & check(F && fn);
 
     // Action to run after all arguments have been parsed, any number of
     // after actions can be added and will, for each option, be called in the
@@ -1491,7 +2003,7 @@ public:
     //  - Do something interesting.
     //  - Call cli.badUsage() and return false on error.
     //  - Return true if processing should continue.
-    A & after(std::function<ActionFn> fn);
+    template <typename F> A & after(F && fn);
 
     //-----------------------------------------------------------------------
     // QUERIES
@@ -1504,12 +2016,17 @@ protected:
     bool doParseAction(Cli & cli, const std::string & value) final;
     bool doCheckActions(Cli & cli, const std::string & value) final;
     bool doAfterActions(Cli & cli) final;
-    bool inverted() const final;
-    bool exec(
+    bool takeValue(std::string & value) final;
+    bool parseValues(
         Cli & cli,
-        const std::string & value,
-        const std::vector<std::function<ActionFn>> & actions
-    );
+        const std::string & name,
+        const size_t pos[],
+        const char * const ptrs[],
+        size_t count
+    ) final;
+    bool inverted() const final;
+    void addFootprint(MemoryStats & out) const override;
+    bool exec(Cli & cli, const std::string & value, size_t first, size_t last);
 
     // If numeric_limits<T>::min & max are defined and 'x' is outside of
     // those limits badRange() is called, otherwise returns true.
@@ -1519,9 +2036,14 @@ protected:
     template <typename U>
     bool checkLimits(Cli & cli, const std::string & val, const U & x, long);
 
-    std::function<ActionFn> m_parse;
-    std::vector<std::function<ActionFn>> m_checks;
-    std::vector<std::function<ActionFn>> m_afters;
+    class Action;
+
+    // Custom parse action, if there is one, followed by the check actions
+    // and then the after actions. Without a custom parse action values are
+    // parsed by calling defParseAction() directly.
+    std::vector<Action> m_actions;
+    bool m_customParse {};
+    unsigned m_afterPos {}; // position of the first after action
 
     T m_implicitValue{};
     T m_defValue{};
@@ -1534,7 +2056,7 @@ Cli::OptShim<A, T>::OptShim(const std::string & names, bool flag)
     : OptBase(names, flag)
 {
     if (std::is_arithmetic<T>::value)
-        this->imbue(std::locale(""));
+        this->m_preferredLocale = true;
 }
 
 //===========================================================================
@@ -1550,7 +2072,9 @@ inline bool Cli::OptShim<A, T>::doParseAction(
     const std::string & val
 ) {
     auto self = static_cast<A *>(this);
-    return m_parse(cli, *self, val);
+    if (!m_customParse)
+        return defParseAction(cli, *self, val);
+    return m_actions[0](cli, *self, val);
 }
 
 //===========================================================================
@@ -1559,13 +2083,75 @@ inline bool Cli::OptShim<A, T>::doCheckActions(
     Cli & cli,
     const std::string & val
 ) {
-    return exec(cli, val, m_checks);
+    return exec(cli, val, m_customParse, m_afterPos);
+}
+
+//===========================================================================
+template <typename A, typename T>
+bool Cli::OptShim<A, T>::parseValues(
+    Cli & cli,
+    const std::string & name,
+    const size_t pos[],
+    const char * const ptrs[],
+    size_t count
+) {
+    auto self = static_cast<A *>(this);
+    self->reserveValues(count);
+    std::string val;
+    for (size_t i = 0; i < count; ++i) {
+        if (!ptrs[i]) {
+            // Implicit values take the long way around.
+            if (!cli.parseValue(*this, name, pos[i], ptrs[i]))
+                return false;
+            continue;
+        }
+        if (!self->A::assign(name, pos[i])) {
+            // Let parseValue() report the excess value.
+            return cli.parseValue(*this, name, pos[i], ptrs[i]);
+        }
+        if (auto arg = cli.ownedArg(pos[i], ptrs[i])) {
+            if (takeValue(*arg))
+                continue;
+        }
+        val = ptrs[i];
+        if (m_customParse) {
+            if (!m_actions[0](cli, *self, val))
+                return false;
+        } else if (!self->A::parseValue(val)) {
+            return badParse(cli, *this, val);
+        }
+        if (!exec(cli, val, m_customParse, m_afterPos))
+            return false;
+    }
+    return true;
+}
+
+//===========================================================================
+template <typename A, typename T>
+inline bool Cli::OptShim<A, T>::takeValue(std::string & value) {
+    if (m_afterPos || this->m_flagValue || !m_choices.empty())
+        return false;
+    return static_cast<A *>(this)->moveValue(
+        value,
+        std::is_same<T, std::string>()
+    );
 }
 
 //===========================================================================
 template <typename A, typename T>
 inline bool Cli::OptShim<A, T>::doAfterActions(Cli & cli) {
-    return exec(cli, {}, m_afters);
+    return exec(cli, {}, m_afterPos, m_actions.size());
+}
+
+//===========================================================================
+template <typename A, typename T>
+inline void Cli::OptShim<A, T>::addFootprint(MemoryStats & out) const {
+    OptBase::addFootprint(out);
+    out.options.bytes += sizeof(A);
+    out.options.add(m_actions);
+    out.options.add(m_implicitValue);
+    out.options.add(m_defValue);
+    out.options.add(m_choices);
 }
 
 //===========================================================================
@@ -1592,11 +2178,12 @@ template <typename A, typename T>
 inline bool Cli::OptShim<A, T>::exec(
     Cli & cli,
     const std::string & val,
-    const std::vector<std::function<ActionFn>> & actions
+    size_t first,
+    size_t last
 ) {
     auto self = static_cast<A *>(this);
-    for (auto && fn : actions) {
-        if (!fn(cli, *self, val))
+    for (auto i = first; i < last; ++i) {
+        if (!m_actions[i](cli, *self, val))
             return false;
     }
     return true;
@@ -1606,6 +2193,7 @@ inline bool Cli::OptShim<A, T>::exec(
 template <typename A, typename T>
 A & Cli::OptShim<A, T>::command(const std::string & val) {
     m_command = val;
+    this->touchDefinition();
     return static_cast<A &>(*this);
 }
 
@@ -1683,6 +2271,7 @@ A & Cli::OptShim<A, T>::flagValue(bool isDefault) {
         m_flagDefault = false;
     }
     m_bool = true;
+    this->touchDefinition();
     return *self;
 }
 
@@ -1690,6 +2279,7 @@ A & Cli::OptShim<A, T>::flagValue(bool isDefault) {
 template <typename A, typename T>
 A & Cli::OptShim<A, T>::finalOpt() {
     this->m_finalOpt = true;
+    this->touchDefinition();
     return static_cast<A &>(*this);
 }
 
@@ -1716,22 +2306,33 @@ A & Cli::OptShim<A, T>::choice(
 
 //===========================================================================
 template <typename A, typename T>
-A & Cli::OptShim<A, T>::parse(std::function<ActionFn> fn) {
-    this->m_parse = move(fn);
+template <typename F>
+A & Cli::OptShim<A, T>::parse(F && fn) {
+    Action act(std::forward<F>(fn));
+    if (m_customParse) {
+        m_actions[0] = std::move(act);
+    } else {
+        m_actions.insert(m_actions.begin(), std::move(act));
+        m_customParse = true;
+        m_afterPos += 1;
+    }
     return static_cast<A &>(*this);
 }
 
 //===========================================================================
 template <typename A, typename T>
-A & Cli::OptShim<A, T>::check(std::function<ActionFn> fn) {
-    this->m_checks.push_back(move(fn));
+template <typename F>
+A & Cli::OptShim<A, T>::check(F && fn) {
+    m_actions.emplace(m_actions.begin() + m_afterPos, std::forward<F>(fn));
+    m_afterPos += 1;
     return static_cast<A &>(*this);
 }
 
 //===========================================================================
 template <typename A, typename T>
-A & Cli::OptShim<A, T>::after(std::function<ActionFn> fn) {
-    this->m_afters.push_back(move(fn));
+template <typename F>
+A & Cli::OptShim<A, T>::after(F && fn) {
+    m_actions.emplace_back(std::forward<F>(fn));
     return static_cast<A &>(*this);
 }
 
@@ -1842,7 +2443,7 @@ A & Cli::OptShim<A, T>::anyUnits(InputIt first, InputIt last, int flags) {
         if (ival == dval) {
             sval = std::to_string(ival);
         } else {
-            success = opt.toString(sval, dval);
+            success = opt.toRoundTripString(sval, dval);
             if (!success) {
                 assert(!"internal dimcli error: "   // LCOV_EXCL_LINE
                     "convert double to string failed");
@@ -1895,6 +2496,145 @@ A & Cli::OptShim<A, T>::prompt(const std::string & msg, int flags) {
 }
 
 
+/****************************************************************************
+*
+*   Cli::OptShim::Action
+*
+*   Parse, check, or after action of an option. Like std::function, except
+*   that it can only be moved and that callables small enough to fit in its
+*   buffer (e.g. lambdas capturing up to three references) are stored inline
+*   instead of on the heap.
+*
+***/
+
+template <typename A, typename T>
+class Cli::OptShim<A, T>::Action {
+public:
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Action>::value>::type>
+    explicit Action(F && fn);
+    Action(Action && from) noexcept;
+    Action & operator=(Action && from) noexcept;
+    ~Action();
+
+    bool operator()(Cli & cli, A & opt, const std::string & val) {
+        return m_ops->call(m_buf, cli, opt, val);
+    }
+
+private:
+    struct Ops {
+        bool (*call)(void * fn, Cli & cli, A & opt, const std::string & val);
+
+        // Moves the callable from src to dst and destroys what's left at
+        // src, or, if dst is null, only destroys it.
+        void (*relocate)(void * dst, void * src);
+    };
+
+    template <typename F>
+    using Inline = std::integral_constant<bool,
+        sizeof(F) <= 3 * sizeof(void *)
+        && alignof(F) <= alignof(void *)
+        && std::is_nothrow_move_constructible<F>::value>;
+    template <typename Fn, typename F> void init(F && fn, std::true_type);
+    template <typename Fn, typename F> void init(F && fn, std::false_type);
+
+    template <typename F>
+    static bool callInline(
+        void * fn,
+        Cli & cli,
+        A & opt,
+        const std::string & val
+    ) {
+        return (*static_cast<F *>(fn))(cli, opt, val);
+    }
+    template <typename F>
+    static void relocateInline(void * dst, void * src) {
+        auto & fn = *static_cast<F *>(src);
+        if (dst)
+            new (dst) F(std::move(fn));
+        fn.~F();
+    }
+    template <typename F>
+    static bool callHeap(
+        void * fn,
+        Cli & cli,
+        A & opt,
+        const std::string & val
+    ) {
+        return (**static_cast<F **>(fn))(cli, opt, val);
+    }
+    template <typename F>
+    static void relocateHeap(void * dst, void * src) {
+        auto & fn = *static_cast<F **>(src);
+        if (dst) {
+            *static_cast<F **>(dst) = fn;
+        } else {
+            delete fn;
+        }
+    }
+
+    const Ops * m_ops;
+    alignas(void *) unsigned char m_buf[3 * sizeof(void *)];
+};
+
+//===========================================================================
+template <typename A, typename T>
+template <typename F, typename>
+Cli::OptShim<A, T>::Action::Action(F && fn) {
+    using Fn = typename std::decay<F>::type;
+    init<Fn>(std::forward<F>(fn), Inline<Fn>());
+}
+
+//===========================================================================
+template <typename A, typename T>
+template <typename Fn, typename F>
+void Cli::OptShim<A, T>::Action::init(F && fn, std::true_type) {
+    static const Ops s_ops = { &callInline<Fn>, &relocateInline<Fn> };
+    new (m_buf) Fn(std::forward<F>(fn));
+    m_ops = &s_ops;
+}
+
+//===========================================================================
+template <typename A, typename T>
+template <typename Fn, typename F>
+void Cli::OptShim<A, T>::Action::init(F && fn, std::false_type) {
+    static const Ops s_ops = { &callHeap<Fn>, &relocateHeap<Fn> };
+    *reinterpret_cast<Fn **>(m_buf) = new Fn(std::forward<F>(fn));
+    m_ops = &s_ops;
+}
+
+//===========================================================================
+template <typename A, typename T>
+Cli::OptShim<A, T>::Action::Action(Action && from) noexcept
+    : m_ops(from.m_ops)
+{
+    m_ops->relocate(m_buf, from.m_buf);
+    from.m_ops = nullptr;
+}
+
+//===========================================================================
+template <typename A, typename T>
+auto Cli::OptShim<A, T>::Action::operator=(Action && from) noexcept
+    -> Action &
+{
+    if (this != &from) {
+        if (m_ops)
+            m_ops->relocate(nullptr, m_buf);
+        m_ops = from.m_ops;
+        m_ops->relocate(m_buf, from.m_buf);
+        from.m_ops = nullptr;
+    }
+    return *this;
+}
+
+//===========================================================================
+template <typename A, typename T>
+Cli::OptShim<A, T>::Action::~Action() {
+    if (m_ops)
+        m_ops->relocate(nullptr, m_buf);
+}
+
+
 /****************************************************************************
 *
 *   Cli::ArgMatch
@@ -1930,6 +2670,11 @@ struct Cli::Value {
     // Points to the opt with the default flag value.
     Opt<T> * m_defFlagOpt{};
 
+    // Last opt added for the value and the parse generation the value was
+    // last reset for, see cli.lazyReset().
+    Opt<T> * m_resetOpt{};
+    unsigned m_generation{};
+
     T * m_value{};
     T m_internal{};
 
@@ -1951,12 +2696,12 @@ public:
     //-----------------------------------------------------------------------
     // QUERIES
 
-    T & operator*() { return *m_proxy->m_value; }
-    T * operator->() { return m_proxy->m_value; }
+    T & operator*() { return *proxy()->m_value; }
+    T * operator->() { return proxy()->m_value; }
 
     // Inherited via OptBase
-    const std::string & from() const final { return m_proxy->m_match.name; }
-    int pos() const final { return m_proxy->m_match.pos; }
+    const std::string & from() const final { return proxy()->m_match.name; }
+    int pos() const final { return proxy()->m_match.pos; }
 
     //-----------------------------------------------------------------------
     // UPDATE VALUE
@@ -1969,11 +2714,19 @@ private:
     friend class Cli;
     bool defaultValueToString(std::string & out) const final;
     bool assign(const std::string & name, size_t pos) final;
-    bool assigned() const final { return m_proxy->m_explicit; }
+    bool assigned() const final { return proxy()->m_explicit; }
     void assignImplicit() final;
-    bool sameValue(const void * value) const final {
-        return value == m_proxy->m_value;
+    void reserveValues(size_t) {}
+    bool moveValue(std::string & value, std::true_type);
+    bool moveValue(std::string &, std::false_type) { return false; }
+    bool externalValue() const final {
+        return m_proxy->m_value != &m_proxy->m_internal;
     }
+    const void * valueAddress() const final { return m_proxy->m_value; }
+    const void * valueProxy() const final { return m_proxy.get(); }
+    std::shared_ptr<void> newValueProxy() const final;
+    void addFootprint(MemoryStats & out) const final;
+    Value<T> * proxy() const;
 
     std::shared_ptr<Value<T>> m_proxy;
 };
@@ -1986,22 +2739,46 @@ Cli::Opt<T>::Opt(
 )
     : OptShim<Opt, T>{names, std::is_same<T, bool>::value}
     , m_proxy{value}
-{}
+{
+    m_proxy->m_resetOpt = this;
+}
+
+//===========================================================================
+template <typename T>
+inline std::shared_ptr<void> Cli::Opt<T>::newValueProxy() const {
+    return std::make_shared<Value<T>>(nullptr);
+}
+
+//===========================================================================
+template <typename T>
+inline Cli::Value<T> * Cli::Opt<T>::proxy() const {
+    if (auto ptr = this->contextProxy())
+        return static_cast<Value<T> *>(ptr);
+    auto px = m_proxy.get();
+    if (this->m_generation && px->m_generation != *this->m_generation) {
+        // Lazy reset, by the opt whose default the value would have been
+        // left with if all the opts had been reset in order.
+        px->m_generation = *this->m_generation;
+        (px->m_defFlagOpt ? px->m_defFlagOpt : px->m_resetOpt)->reset();
+    }
+    return px;
+}
 
 //===========================================================================
 template <typename T>
 inline void Cli::Opt<T>::reset() {
+    auto px = proxy();
     if (!this->m_flagValue || this->m_flagDefault)
-        *m_proxy->m_value = this->defaultValue();
-    m_proxy->m_match.name.clear();
-    m_proxy->m_match.pos = 0;
-    m_proxy->m_explicit = false;
+        *px->m_value = this->defaultValue();
+    px->m_match.name.clear();
+    px->m_match.pos = 0;
+    px->m_explicit = false;
 }
 
 //===========================================================================
 template <typename T>
 inline bool Cli::Opt<T>::parseValue(const std::string & value) {
-    auto & tmp = *m_proxy->m_value;
+    auto & tmp = *proxy()->m_value;
     if (this->m_flagValue) {
         // Value passed for flagValue (just like bools) is generated
         // internally and will be 0 or 1.
@@ -2023,6 +2800,13 @@ inline bool Cli::Opt<T>::parseValue(const std::string & value) {
     return this->fromString(tmp, value);
 }
 
+//===========================================================================
+template <typename T>
+inline bool Cli::Opt<T>::moveValue(std::string & value, std::true_type) {
+    *proxy()->m_value = std::move(value);
+    return true;
+}
+
 //===========================================================================
 template <typename T>
 inline bool Cli::Opt<T>::defaultValueToString(std::string & out) const {
@@ -2032,16 +2816,32 @@ inline bool Cli::Opt<T>::defaultValueToString(std::string & out) const {
 //===========================================================================
 template <typename T>
 inline bool Cli::Opt<T>::assign(const std::string & name, size_t pos) {
-    m_proxy->m_match.name = name;
-    m_proxy->m_match.pos = (int)pos;
-    m_proxy->m_explicit = true;
+    auto px = proxy();
+    px->m_match.name = name;
+    px->m_match.pos = (int)pos;
+    px->m_explicit = true;
     return true;
 }
 
 //===========================================================================
 template <typename T>
 inline void Cli::Opt<T>::assignImplicit() {
-    *m_proxy->m_value = this->implicitValue();
+    *proxy()->m_value = this->implicitValue();
+}
+
+//===========================================================================
+template <typename T>
+inline void Cli::Opt<T>::addFootprint(MemoryStats & out) const {
+    OptShim<Opt, T>::addFootprint(out);
+
+    // The feature switches of a flag value share one proxy, it's counted
+    // with the default switch.
+    if (m_proxy->m_defFlagOpt && m_proxy->m_defFlagOpt != this)
+        return;
+    out.options.bytes += sizeof(*m_proxy) + 2 * sizeof(long);
+    out.options.add(m_proxy->m_match.name);
+    if (m_proxy->m_value == &m_proxy->m_internal)
+        out.options.add(m_proxy->m_internal);
 }
 
 
@@ -2059,6 +2859,11 @@ struct Cli::ValueVec {
     // Points to the opt with the default flag value.
     OptVec<T> * m_defFlagOpt{};
 
+    // Last opt added for the values and the parse generation they were last
+    // reset for, see cli.lazyReset().
+    OptVec<T> * m_resetOpt{};
+    unsigned m_generation{};
+
     std::vector<T> * m_values{};
     std::vector<T> m_internal;
 
@@ -2090,10 +2895,10 @@ public:
     //-----------------------------------------------------------------------
     // QUERIES
 
-    std::vector<T> & operator*() { return *m_proxy->m_values; }
-    std::vector<T> * operator->() { return m_proxy->m_values; }
+    std::vector<T> & operator*() { return *proxy()->m_values; }
+    std::vector<T> * operator->() { return proxy()->m_values; }
 
-    T & operator[](size_t index) { return (*m_proxy->m_values)[index]; }
+    T & operator[](size_t index) { return (*proxy()->m_values)[index]; }
     const T & operator[](size_t index) const {
         return const_cast<T *>(this)[index];
     }
@@ -2107,7 +2912,7 @@ public:
     // Inherited via OptBase
     const std::string & from() const final { return from(size() - 1); }
     int pos() const final { return pos(size() - 1); }
-    size_t size() const final { return m_proxy->m_values->size(); }
+    size_t size() const final { return proxy()->m_values->size(); }
     int minSize() const final { return m_minVec; }
     int maxSize() const final { return m_maxVec; }
 
@@ -2122,11 +2927,19 @@ private:
     friend class Cli;
     bool defaultValueToString(std::string & out) const final;
     bool assign(const std::string & name, size_t pos) final;
-    bool assigned() const final { return !m_proxy->m_values->empty(); }
+    bool assigned() const final { return !proxy()->m_values->empty(); }
     void assignImplicit() final;
-    bool sameValue(const void * value) const final {
-        return value == m_proxy->m_values;
+    void reserveValues(size_t count);
+    bool moveValue(std::string & value, std::true_type);
+    bool moveValue(std::string &, std::false_type) { return false; }
+    bool externalValue() const final {
+        return m_proxy->m_values != &m_proxy->m_internal;
     }
+    const void * valueAddress() const final { return m_proxy->m_values; }
+    const void * valueProxy() const final { return m_proxy.get(); }
+    std::shared_ptr<void> newValueProxy() const final;
+    void addFootprint(MemoryStats & out) const final;
+    ValueVec<T> * proxy() const;
 
     std::shared_ptr<ValueVec<T>> m_proxy;
     std::string m_empty;
@@ -2145,6 +2958,7 @@ Cli::OptVec<T>::OptVec(
     : OptShim<OptVec, T>{names, std::is_same<T, bool>::value}
     , m_proxy(values)
 {
+    m_proxy->m_resetOpt = this;
     this->m_vector = true;
     this->m_minVec = 1;
     this->m_maxVec = -1;
@@ -2157,6 +2971,7 @@ inline Cli::OptVec<T> & Cli::OptVec<T>::size(int exact) {
         assert(!"bad optVec size, minimum must be >= 0");
     } else {
         this->m_minVec = this->m_maxVec = exact;
+        this->touchDefinition();
     }
     return *this;
 }
@@ -2173,14 +2988,36 @@ inline Cli::OptVec<T> & Cli::OptVec<T>::size(int min, int max) {
     } else {
         this->m_minVec = min;
         this->m_maxVec = max;
+        this->touchDefinition();
     }
     return *this;
 }
 
+//===========================================================================
+template <typename T>
+inline std::shared_ptr<void> Cli::OptVec<T>::newValueProxy() const {
+    return std::make_shared<ValueVec<T>>(nullptr);
+}
+
+//===========================================================================
+template <typename T>
+inline Cli::ValueVec<T> * Cli::OptVec<T>::proxy() const {
+    if (auto ptr = this->contextProxy())
+        return static_cast<ValueVec<T> *>(ptr);
+    auto px = m_proxy.get();
+    if (this->m_generation && px->m_generation != *this->m_generation) {
+        // Lazy reset, see Opt<T>::proxy().
+        px->m_generation = *this->m_generation;
+        px->m_resetOpt->reset();
+    }
+    return px;
+}
+
 //===========================================================================
 template <typename T>
 inline bool Cli::OptVec<T>::parseValue(const std::string & value) {
-    auto back = std::prev(m_proxy->m_values->end());
+    auto px = proxy();
+    auto back = std::prev(px->m_values->end());
     if (this->m_flagValue) {
         // Value passed for flagValue (just like bools) is generated
         // internally and will be 0 or 1.
@@ -2191,8 +3028,8 @@ inline bool Cli::OptVec<T>::parseValue(const std::string & value) {
                 assert(!"internal dimcli error: "   // LCOV_EXCL_LINE
                     "flagValue not parsed from 0 or 1");
             }
-            m_proxy->m_values->pop_back();
-            m_proxy->m_matches.pop_back();
+            px->m_values->pop_back();
+            px->m_matches.pop_back();
         }
         return true;
     }
@@ -2222,15 +3059,17 @@ inline bool Cli::OptVec<T>::defaultValueToString(std::string & out) const {
 //===========================================================================
 template <typename T>
 inline void Cli::OptVec<T>::reset() {
-    m_proxy->m_values->clear();
-    m_proxy->m_matches.clear();
+    auto px = proxy();
+    px->m_values->clear();
+    px->m_matches.clear();
 }
 
 //===========================================================================
 template <typename T>
 inline bool Cli::OptVec<T>::assign(const std::string & name, size_t pos) {
+    auto px = proxy();
     if (this->m_maxVec != -1
-        && (size_t) this->m_maxVec == m_proxy->m_matches.size()
+        && (size_t) this->m_maxVec == px->m_matches.size()
     ) {
         return false;
     }
@@ -2238,15 +3077,48 @@ inline bool Cli::OptVec<T>::assign(const std::string & name, size_t pos) {
     ArgMatch match;
     match.name = name;
     match.pos = (int)pos;
-    m_proxy->m_matches.push_back(match);
-    m_proxy->m_values->resize(m_proxy->m_matches.size());
+    px->m_matches.push_back(match);
+    px->m_values->resize(px->m_matches.size());
+    return true;
+}
+
+//===========================================================================
+template <typename T>
+inline void Cli::OptVec<T>::reserveValues(size_t count) {
+    auto px = proxy();
+    px->m_matches.reserve(px->m_matches.size() + count);
+    px->m_values->reserve(px->m_values->size() + count);
+}
+
+//===========================================================================
+template <typename T>
+inline bool Cli::OptVec<T>::moveValue(std::string & value, std::true_type) {
+    proxy()->m_values->back() = std::move(value);
     return true;
 }
 
 //===========================================================================
 template <typename T>
 inline void Cli::OptVec<T>::assignImplicit() {
-    m_proxy->m_values->back() = this->implicitValue();
+    proxy()->m_values->back() = this->implicitValue();
+}
+
+//===========================================================================
+template <typename T>
+inline void Cli::OptVec<T>::addFootprint(MemoryStats & out) const {
+    OptShim<OptVec, T>::addFootprint(out);
+    out.options.add(m_empty);
+
+    // The feature switches of a flag value share one proxy, it's counted
+    // with the default switch.
+    if (m_proxy->m_defFlagOpt && m_proxy->m_defFlagOpt != this)
+        return;
+    out.options.bytes += sizeof(*m_proxy) + 2 * sizeof(long);
+    out.options.add(m_proxy->m_matches);
+    for (auto && match : m_proxy->m_matches)
+        out.options.add(match.name);
+    if (m_proxy->m_values == &m_proxy->m_internal)
+        out.options.add(m_proxy->m_internal);
 }
 
 //===========================================================================
@@ -2255,16 +3127,120 @@ inline const std::string & Cli::OptVec<T>::from(size_t index) const {
     if (index >= size()) {
         return m_empty;
     } else {
-        return m_proxy->m_matches[index].name;
+        return proxy()->m_matches[index].name;
     }
 }
 
 //===========================================================================
 template <typename T>
 inline int Cli::OptVec<T>::pos(size_t index) const {
-    return index >= size() ? 0 : m_proxy->m_matches[index].pos;
+    return index >= size() ? 0 : proxy()->m_matches[index].pos;
 }
 
+
+/****************************************************************************
+*
+*   Cli::Context
+*
+*   Results of parsing a frozen cli, see cli.freeze(). Holds its own copy of
+*   all option values, which it creates the first time it's parsed into and
+*   then reuses for later parses of the same cli.
+*
+***/
+
+class DIMCLI_LIB_DECL Cli::Context {
+public:
+    struct State;
+
+    // Makes the context active on the calling thread until the scope ends,
+    // so that option queries (*opt, opt.from(), etc) and the result queries
+    // of the cli (cli.exitCode(), etc) refer to it. Parsing into, or
+    // executing with, a context does this for the duration of the call.
+    class DIMCLI_LIB_DECL Scope {
+    public:
+        explicit Scope(Context & ctx);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+
+    private:
+        Context * m_prev;
+    };
+
+public:
+    Context();
+    Context(Context && from) noexcept;
+    Context & operator=(Context && from) noexcept;
+    ~Context();
+
+    // Same as the cli queries of the same names, for the last parse into
+    // this context.
+    int exitCode() const;
+    const std::string & errMsg() const;
+    const std::string & errDetail() const;
+    const std::string & progName() const;
+    const std::string & commandMatched() const;
+    const std::vector<std::string> & unknownArgs() const;
+
+    // Value of the option in this context, the option must belong to the
+    // cli that was last parsed into it.
+    template <typename T> T & operator[](Opt<T> & opt);
+    template <typename T> std::vector<T> & operator[](OptVec<T> & opt);
+
+private:
+    friend class Cli;
+    void * proxy(const OptBase & opt) const;
+
+    std::unique_ptr<State> m_state;
+};
+
+//===========================================================================
+template <typename T>
+inline T & Cli::Context::operator[](Opt<T> & opt) {
+    return *static_cast<Value<T> *>(proxy(opt))->m_value;
+}
+
+//===========================================================================
+template <typename T>
+inline std::vector<T> & Cli::Context::operator[](OptVec<T> & opt) {
+    return *static_cast<ValueVec<T> *>(proxy(opt))->m_values;
+}
+
+
+/****************************************************************************
+*
+*   Cli::ResponseFileCache
+*
+*   Tokenized args of response files, see cli.responseFileCache(). Files are
+*   identified by path and checked for changes, by their size, modification
+*   time, and file system id, each time they're used. The least recently
+*   used files are evicted to keep the memory of the cached args under the
+*   limit. Thread safe.
+*
+***/
+
+class DIMCLI_LIB_DECL Cli::ResponseFileCache {
+public:
+    struct State;
+
+public:
+    explicit ResponseFileCache(size_t maxBytes = 16 * 1024 * 1024);
+    ~ResponseFileCache();
+    ResponseFileCache(const ResponseFileCache &) = delete;
+    ResponseFileCache & operator=(const ResponseFileCache &) = delete;
+
+    // Removes all files from the cache.
+    void clear();
+
+    // Number of files cached, and approximate memory used by their args.
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    friend class Cli;
+    std::unique_ptr<State> m_state;
+};
+
 } // namespace
 
 
@@ -28,6 +28,168 @@ const char kCommand[] = "test";
 
 static int s_errors;
 
+// Number of times global operator new has been called.
+static atomic<size_t> s_allocs;
+
+
+/****************************************************************************
+*
+*   Allocation counting
+*
+***/
+
+//===========================================================================
+// Every form of global operator new and delete is replaced, so that memory
+// is never allocated by the runtime's version and freed by ours.
+static void * allocMem(size_t size, size_t align = 0) {
+    s_allocs += 1;
+    if (!size)
+        size = 1;
+    if (!align)
+        return malloc(size);
+    size = (size + align - 1) / align * align;
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return aligned_alloc(align, size);
+#endif
+}
+
+//===========================================================================
+static void freeMem(void * ptr, size_t align = 0) {
+#ifdef _WIN32
+    if (align)
+        return _aligned_free(ptr);
+#else
+    (void) align;
+#endif
+    free(ptr);
+}
+
+//===========================================================================
+void * operator new(size_t size) {
+    if (auto ptr = allocMem(size))
+        return ptr;
+    throw bad_alloc();
+}
+
+//===========================================================================
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+//===========================================================================
+void * operator new(size_t size, const nothrow_t &) noexcept {
+    return allocMem(size);
+}
+
+//===========================================================================
+void * operator new[](size_t size, const nothrow_t &) noexcept {
+    return allocMem(size);
+}
+
+//===========================================================================
+void operator delete(void * ptr) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete[](void * ptr) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete(void * ptr, size_t) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, size_t) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete(void * ptr, const nothrow_t &) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, const nothrow_t &) noexcept {
+    freeMem(ptr);
+}
+
+#ifdef __cpp_aligned_new
+
+//===========================================================================
+void * operator new(size_t size, align_val_t align) {
+    if (auto ptr = allocMem(size, (size_t) align))
+        return ptr;
+    throw bad_alloc();
+}
+
+//===========================================================================
+void * operator new[](size_t size, align_val_t align) {
+    return operator new(size, align);
+}
+
+//===========================================================================
+void * operator new(
+    size_t size,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    return allocMem(size, (size_t) align);
+}
+
+//===========================================================================
+void * operator new[](
+    size_t size,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    return allocMem(size, (size_t) align);
+}
+
+//===========================================================================
+void operator delete(void * ptr, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete(void * ptr, size_t, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, size_t, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete(
+    void * ptr,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete[](
+    void * ptr,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+#endif
+
 
 /****************************************************************************
 *
@@ -389,6 +551,65 @@ void valueTests() {
         EXPECT(*sum == 6);
     }
 
+    // locale of option
+    {
+        struct CommaDecimal : numpunct<char> {
+            char do_decimal_point() const override { return ','; }
+        };
+        cli = {};
+        auto & a = cli.opt<double>("a");
+        auto & b = cli.opt<double>("b");
+        a.imbue(locale(locale::classic(), new CommaDecimal));
+        EXPECT_PARSE(cli, "-a 1,5 -b 2.5");
+        EXPECT(*a == 1.5 && *b == 2.5);
+        EXPECT_PARSE(cli, "-a 1.5", false);
+        EXPECT_ERR(cli, "Error: Invalid '-a' value: 1.5\n");
+        string out;
+        EXPECT(a.toString(out, 0.5) && out == "0,5");
+        EXPECT(b.toString(out, 0.5) && out == "0.5");
+
+        struct Grouped : numpunct<char> {
+            char do_thousands_sep() const override { return ','; }
+            string do_grouping() const override { return "\3"; }
+        };
+        auto & c = cli.opt<int>("c");
+        c.imbue(locale(locale::classic(), new Grouped));
+        EXPECT_PARSE(cli, "-c 1,234");
+        EXPECT(*c == 1234);
+        EXPECT_PARSE(cli, "-c 5678");
+        EXPECT(*c == 5678);
+        EXPECT(c.toString(out, 1234) && out == "1,234");
+        EXPECT(c.toString(out, -123) && out == "-123");
+    }
+
+    // numbers
+    {
+        cli = {};
+        auto & i = cli.opt<int>("i");
+        auto & u = cli.opt<unsigned>("u");
+        auto & d = cli.opt<double>("d");
+        EXPECT_PARSE(cli, "-i0x1F -u0o17 -d.5e1");
+        EXPECT(*i == 31 && *u == 15 && *d == 5);
+        EXPECT_PARSE(cli, "-i-0X10 -u010 -d+1.25");
+        EXPECT(*i == -16 && *u == 10 && *d == 1.25);
+        EXPECT_PARSE(cli, "-i0x", false);
+        EXPECT_ERR(cli, "Error: Invalid '-i' value: 0x\n");
+        EXPECT_PARSE(cli, "-i1e3", false);
+        EXPECT_ERR(cli, "Error: Invalid '-i' value: 1e3\n");
+        EXPECT_PARSE(cli, "-i2147483648", false);
+        EXPECT_ERR(cli, "Error: Invalid '-i' value: 2147483648\n");
+        EXPECT_PARSE(cli, "-dinf", false);
+        EXPECT_ERR(cli, "Error: Invalid '-d' value: inf\n");
+        EXPECT_PARSE(cli, "-d1e999", false);
+        EXPECT_ERR(cli, "Error: Invalid '-d' value: 1e999\n");
+        EXPECT_PARSE(cli, "-d1e-999");
+        EXPECT(*d == 0);
+        string out;
+        EXPECT(d.toString(out, 1234567.0) && out == "1.23457e+06");
+        EXPECT(d.toString(out, 0.1) && out == "0.1");
+        EXPECT(i.toString(out, -2147483647 - 1) && out == "-2147483648");
+    }
+
     // parsing failure
     {
         cli = {};
@@ -467,7 +688,7 @@ Options:
 
 //===========================================================================
 void parseTests() {
-    //int line = 0;
+    int line = 0;
     CliTest cli;
 
     EXPECT_PARSE(cli, "-x", false);
@@ -502,6 +723,69 @@ void parseTests() {
     cli.opt("<n>", 1);
     EXPECT_PARSE(cli, "", false);
     EXPECT_ERR(cli, "Error: Option 'n' missing value.\n");
+
+    // definition changes between parses
+    cli = {};
+    auto & a = cli.opt<int>("a");
+    EXPECT_PARSE(cli, "-a1 -b2", false);
+    EXPECT_ERR(cli, "Error: Unknown option: -b\n");
+    auto & b = cli.opt<int>("b");
+    EXPECT_PARSE(cli, "-a1 -b2");
+    EXPECT(*a == 1 && *b == 2);
+    b.command("x");
+    EXPECT_PARSE(cli, "-b3", false);
+    EXPECT_ERR(cli, "Error: Unknown option: -b\n");
+    EXPECT_PARSE(cli, "x -b3");
+    EXPECT(*b == 3);
+
+    // lots of long names
+    cli = {};
+    vector<Dim::Cli::Opt<int> *> many;
+    for (auto i = 0; i < 300; ++i) {
+        auto num = to_string(i);
+        many.push_back(&cli.opt<int>("n" + num + " name" + num));
+    }
+    EXPECT_PARSE(cli, "--name0=1 --name299 2 --n150=3 -n", false);
+    EXPECT_ERR(cli, "Error: Unknown option: -n\n");
+    EXPECT_PARSE(cli, "--name0=1 --name299 2 --n150=3");
+    EXPECT(**many[0] == 1 && **many[299] == 2 && **many[150] == 3);
+    EXPECT_PARSE(cli, "--name300", false);
+    EXPECT_ERR(cli, "Error: Unknown option: --name300\n");
+
+    // lots of long names with a long common prefix, every one is found
+    cli = {};
+    many.clear();
+    const string prefix = "a-rather-long-common-prefix-of-option-names-";
+    string cmdline;
+    for (auto i = 0; i < 400; ++i) {
+        auto name = prefix + to_string(i);
+        many.push_back(&cli.opt<int>(name + " " + name + "-alias"));
+        cmdline += " --" + name + (i % 2 ? "=" : "-alias=") + to_string(i);
+    }
+    EXPECT_PARSE(cli, cmdline);
+    for (auto i = 0; i < 400; ++i)
+        EXPECT(**many[i] == i);
+    EXPECT_PARSE(cli, "--" + prefix, false);
+    EXPECT_ERR(cli, "Error: Unknown option: --" + prefix + "\n");
+    EXPECT_PARSE(cli, "--" + prefix + "400", false);
+
+    // parse directly from argv
+    cli = {};
+    auto & v = cli.opt<bool>("v verbose");
+    auto & n = cli.opt<int>("n");
+    auto & oprs = cli.optVec<string>("[operands]");
+    vector<string> args = {kCommand, "-vn", "2", "--no-verbose", "a", "--",
+        "-b"};
+    vector<char *> argv;
+    for (auto && arg : args)
+        argv.push_back(arg.data());
+    EXPECT(cli.parse(argv.size(), argv.data()));
+    EXPECT(!*v && v.from() == "--no-verbose");
+    EXPECT(*n == 2 && n.from() == "-n");
+    EXPECT(oprs.size() == 2 && oprs[1] == "-b" && oprs.from() == "operands");
+    argv = {args[0].data(), args[1].data()};
+    EXPECT(!cli.parse(argv.size(), argv.data()));
+    EXPECT_ERR(cli, "Error: No value given for -n\n");
 }
 
 
@@ -724,6 +1008,22 @@ Usage: test
 )");
     }
 
+    // redefined names are listed in the order of their last definition
+    {
+        cli = {};
+        cli.opt<int>("a b xx yy").desc("first");
+        cli.opt<int>("c zz a xx").desc("second");
+        EXPECT_HELP(cli, {}, 1 + R"(
+Usage: test [OPTIONS]
+
+Options:
+  -b, --yy=NUM            first (default: 0)
+  -c, -a, --zz, --xx=NUM  second (default: 0)
+
+  --help                  Show this message and exit.
+)");
+    }
+
     {
         cli = {};
         auto & num = cli.opt("n quantity", 1).desc("quantity is an int");
@@ -1503,6 +1803,10 @@ void responseTests() {
 
     EXPECT_PARSE(cli, "@test/cL.rsp @test/f.rsp");
     EXPECT(*args == vector<string>{"c1", "c2", "f"});
+    EXPECT_PARSE(cli, "a @test/a.rsp b @test/f.rsp @test/cL.rsp c");
+    EXPECT(*args == vector<string>{
+        "a", "1", "x", "y", "2", "b", "f", "c1", "c2", "c"
+    });
 
     EXPECT_PARSE(cli, "@test/gBad.rsp", false);
     EXPECT_ERR(cli, "Error: Invalid encoding: eBad.rsp\n");
@@ -1513,6 +1817,109 @@ void responseTests() {
     EXPECT_PARSE(cli, "@test/reX.rsp", false);
     EXPECT_ERR(cli, "Error: Recursive response file: reX.rsp\n");
 
+    // args are left as they were when the expansion fails
+    {
+        vector<string> rargs = {
+            "a", "b", "@test/a.rsp", "c", "@test/f.rsp", "d",
+            "@test/reX.rsp", "e"
+        };
+        auto orig = rargs;
+        EXPECT(!cli.parse(rargs));
+        EXPECT(rargs == orig);
+        rargs[6] = "@test/does_not_exist.rsp";
+        orig = rargs;
+        EXPECT(!cli.parse(rargs));
+        EXPECT(rargs == orig);
+    }
+
+    // cached response files are only read again after they change
+    {
+        using Cache = Dim::Cli::ResponseFileCache;
+        auto cache = make_shared<Cache>();
+        cli.responseFileCache(cache);
+        EXPECT_PARSE(cli, "@test/a.rsp");
+        EXPECT(cache->size() == 2 && cache->bytes() > 0);
+        auto mtime = fs::last_write_time("test/bu8.rsp");
+        writeRsp("test/bu8.rsp", u8"\ufeffX\nY\n");
+        fs::last_write_time("test/bu8.rsp", mtime);
+        EXPECT_PARSE(cli, "@test/a.rsp");
+        EXPECT(*args == vector<string>{"1", "x", "y", "2"});
+        writeRsp("test/bu8.rsp", u8"\ufeffx\ny\nz\n");
+        EXPECT_PARSE(cli, "@test/a.rsp");
+        EXPECT(*args == vector<string>{"1", "x", "y", "z", "2"});
+        writeRsp("test/bu8.rsp", u8"\ufeffx\ny\n");
+        EXPECT(cache->size() == 2);
+
+        // shared by clis on many threads
+        atomic<int> errors{0};
+        vector<thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                Dim::CliLocal tcli;
+                tcli.responseFileCache(cache);
+                auto & targs = tcli.optVec<string>("[ARGS]");
+                for (int i = 0; i < 50; ++i) {
+                    if (!tcli.parse(tcli.toArgvL(kCommand, "@test/a.rsp"))
+                        || *targs != vector<string>{"1", "x", "y", "2"}
+                    ) {
+                        errors += 1;
+                    }
+                }
+            });
+        }
+        for (auto && th : threads)
+            th.join();
+        EXPECT(errors == 0);
+
+        // least recently used files are evicted to stay within the limit
+        auto small = make_shared<Cache>(cache->bytes() - 1);
+        cli.responseFileCache(small);
+        EXPECT_PARSE(cli, "@test/a.rsp");
+        EXPECT(small->size() == 1 && small->bytes() < cache->bytes());
+        cache->clear();
+        EXPECT(cache->size() == 0 && cache->bytes() == 0);
+        cli.responseFileCache(nullptr);
+    }
+
+    // top level files loaded concurrently, still expanded in order
+    {
+        cli.responseFileThreads(3);
+        EXPECT_PARSE(cli, "@test/a.rsp z @test/cL.rsp @test/f.rsp");
+        EXPECT(*args == vector<string>{
+            "1", "x", "y", "2", "z", "c1", "c2", "f"
+        });
+        EXPECT_PARSE(cli, "@test/gBad.rsp @test/does_not_exist.rsp", false);
+        EXPECT_ERR(cli, "Error: Invalid encoding: eBad.rsp\n");
+        EXPECT_PARSE(cli, "@test/reA.rsp @test/eBad.rsp", false);
+        EXPECT_ERR(cli, "Error: Recursive response file: reA.rsp\n");
+        cli.responseFileCache(make_shared<Dim::Cli::ResponseFileCache>());
+        EXPECT_PARSE(cli, "@test/f.rsp @test/a.rsp @test/f.rsp");
+        EXPECT_PARSE(cli, "@test/f.rsp @test/a.rsp @test/f.rsp");
+        EXPECT(*args == vector<string>{"f", "1", "x", "y", "2", "f"});
+        cli.responseFileCache(nullptr);
+        cli.responseFileThreads(1);
+    }
+
+    // large files are mapped, with and without byte order marks
+    {
+        string u8 = "\xef\xbb\xbf";
+        wstring wide = L"\ufeff";
+        for (int i = 0; i < 20000; ++i) {
+            u8 += "arg" + to_string(i) + '\n';
+            wide += L"w" + to_wstring(i) + L' ';
+        }
+        fstream f("test/iLarge.rsp", ios::out | ios::trunc | ios::binary);
+        f.write(u8.data(), u8.size());
+        f.close();
+        f.open("test/jLarge.rsp", ios::out | ios::trunc | ios::binary);
+        f.write((char *) wide.data(), wide.size() * sizeof wide[0]);
+        f.close();
+        EXPECT_PARSE(cli, "@test/iLarge.rsp x @test/jLarge.rsp");
+        EXPECT(args.size() == 40001 && args[0] == "arg0");
+        EXPECT(args[19999] == "arg19999" && args[20000] == "x");
+        EXPECT(args[20001] == "w0" && args[40000] == "w19999");
+    }
+
 #ifdef _MSC_VER
     {
         fstream f("test/f.rsp", ios::in, _SH_DENYRW);
@@ -1618,6 +2025,62 @@ void execTests() {
         EXPECT(rc == Dim::kExitUsage);
         EXPECT(out.str() == "Error: No command given.\n");
     }
+
+    // phase timing
+    {
+        using Cli = Dim::Cli;
+        cli = {};
+        cli.opt<int>("n number").after([](auto &, auto &, auto &) {
+            return true;
+        });
+        cli.command("go").action([](auto &) {});
+        cli.optVec<string>("[files]").command("go");
+        auto args = cli.toArgv(kCommand + " -n1 go a"s);
+        EXPECT(cli.exec(args) == 0);
+        EXPECT(cli.phaseEvents().empty());
+
+        cli.phaseTiming();
+        EXPECT(cli.exec(args) == 0);
+        // Response files are only expanded if there's filesystem support.
+        vector<Cli::Phase> phases;
+        const Cli::OptBase * parsed = nullptr;
+        for (auto && ev : cli.phaseEvents()) {
+            if (ev.phase == Cli::kPhaseResponseFiles)
+                continue;
+            if (ev.phase == Cli::kPhaseParse && !parsed)
+                parsed = ev.opt;
+            phases.push_back(ev.phase);
+        }
+        EXPECT(phases == vector<Cli::Phase>{
+            Cli::kPhaseMatch,
+            Cli::kPhaseOperands,
+            Cli::kPhaseMatch,
+            Cli::kPhaseOperands,
+            Cli::kPhaseParse,
+            Cli::kPhaseCheck,
+            Cli::kPhaseParse,
+            Cli::kPhaseCheck,
+            Cli::kPhaseCheck,
+            Cli::kPhaseAfter,
+            Cli::kPhaseAfter,
+            Cli::kPhaseAfter,
+            Cli::kPhaseAfter,
+            Cli::kPhaseCommand,
+        });
+        EXPECT(parsed && parsed->defaultFrom() == "-n");
+        EXPECT(cli.phaseTime(Cli::kPhaseEnv).count() == 0);
+        out.clear();
+        out.str({});
+        cli.writeTrace(out);
+        auto trace = out.str();
+        EXPECT(trace.find("{\"traceEvents\": [\n{\"name\": ") == 0);
+        EXPECT(trace.find("\"args\": {\"opt\": \"files\"}") != string::npos);
+        EXPECT(cli.phaseName(Cli::kPhaseResponseFiles) == "response files"s);
+
+        EXPECT(cli.parse(cli.toArgv(kCommand + " -n1"s)));
+        EXPECT(cli.phaseEvents().back().phase == Cli::kPhaseAfter);
+        EXPECT(cli.phaseTime(Cli::kPhaseCommand).count() == 0);
+    }
 }
 
 
@@ -1830,6 +2293,28 @@ Must have 2 values.
         EXPECT(*v2 == vector<int>{3});
         EXPECT(*v3 == vector<int>{4, 5});
     }
+
+    // runs of values for the same option, checked as each is added
+    {
+        cli = {};
+        vector<size_t> sizes;
+        auto & nums = cli.optVec<int>("[nums]").size(0, 4)
+            .check([&](auto &, auto & opt, auto &) {
+                sizes.push_back(opt.size());
+                return true;
+            });
+        EXPECT_PARSE(cli, "1 2 3");
+        EXPECT(*nums == vector<int>{1, 2, 3});
+        EXPECT(sizes == vector<size_t>{1, 2, 3});
+        EXPECT_PARSE(cli, "1 x 3", false);
+        EXPECT_ERR(cli, "Error: Invalid 'nums' value: x\n");
+        EXPECT(nums.size() == 2);
+
+        cli.optVec<int>("n").size(1, 2);
+        EXPECT_PARSE(cli, "-n1 -n2 -n3", false);
+        EXPECT_ERR(cli, "Error: Too many '-n' values: 3\n"
+            "The maximum number of values is 2.\n");
+    }
 }
 
 
@@ -2012,6 +2497,8 @@ Must be between '-2,147,483,648' and '2,147,483,647'.
         auto & sd = cli.opt<double>("d").siUnits();
         EXPECT_PARSE(cli, "-d2.k");
         EXPECT(*sd == 2000);
+        EXPECT_PARSE(cli, "-d1.23456789k");
+        EXPECT(*sd == 1234.56789);
 
         EnumAB seRaw;
         auto & se = cli.opt(&seRaw, "e").siUnits();
@@ -2276,6 +2763,620 @@ void finalOptTests() {
 }
 
 
+/****************************************************************************
+*
+*   Parse contexts
+*
+***/
+
+//===========================================================================
+void contextTests() {
+    int line = 0;
+    CliTest cli;
+    using Context = Dim::Cli::Context;
+
+    auto & num = cli.opt<int>("n number", 5);
+    auto & name = cli.opt<string>("name");
+    name.after([](auto &, auto & opt, auto &) {
+        if (*opt == "bad")
+            *opt = "good";
+        return true;
+    });
+    auto & files = cli.optVec<string>("[files]").command("go");
+    cli.command("go").action([&](auto & cli) {
+        if (files.size() != 2)
+            cli.fail(Dim::kExitSoftware, "Wrong number of files.");
+    });
+    EXPECT(!cli.frozen());
+    cli.freeze();
+    EXPECT(cli.frozen());
+    EXPECT(cli.parse(cli.toArgv(kCommand + " -n7"s)));
+
+    // values are kept separately by each context
+    {
+        Context one;
+        Context two;
+        Context bad;
+        EXPECT(cli.parse(one, cli.toArgv(kCommand + " -n1 --name=bad"s)));
+        EXPECT(cli.parse(two, cli.toArgv(kCommand + " -n2 go a b"s)));
+        EXPECT(!cli.parse(bad, cli.toArgv(kCommand + " -nx"s)));
+        EXPECT(one[num] == 1 && one[name] == "good");
+        EXPECT(two[num] == 2 && two[name].empty());
+        EXPECT(two.commandMatched() == "go");
+        EXPECT(two[files] == vector<string>{"a", "b"});
+        EXPECT(bad.exitCode() == Dim::kExitUsage);
+        EXPECT(bad.errMsg() == "Invalid '-n' value: x");
+        EXPECT(one.exitCode() == Dim::kExitOk);
+        EXPECT(cli.exitCode() == Dim::kExitOk && *num == 7);
+        EXPECT(cli.exec(two) == Dim::kExitOk);
+
+        Context::Scope scope(one);
+        EXPECT(*num == 1 && num.from() == "-n");
+        EXPECT(*name == "good" && !files);
+        EXPECT(cli.commandMatched().empty());
+    }
+
+    // many threads parsing at once
+    {
+        atomic<int> errors{0};
+        vector<thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                Context ctx;
+                for (int i = 0; i < 200; ++i) {
+                    auto val = to_string(t * 1000 + i);
+                    auto args = cli.toArgvL(kCommand, "-n", val, "go", val, 1);
+                    if (!cli.parse(ctx, args)
+                        || ctx[num] != t * 1000 + i
+                        || ctx[files][0] != val
+                        || cli.exec(ctx) != Dim::kExitOk
+                    ) {
+                        errors += 1;
+                    }
+                }
+            });
+        }
+        for (auto && th : threads)
+            th.join();
+        EXPECT(errors == 0);
+        EXPECT(*num == 7 && files.size() == 0);
+    }
+
+    // batch of command lines
+    {
+        vector<string> cmdlines;
+        for (int i = 0; i < 1000; ++i)
+            cmdlines.push_back(kCommand + " -n"s + to_string(i) + " go a b");
+        cmdlines[500] = kCommand + " -nx"s;
+        vector<int> nums(cmdlines.size());
+        auto res = cli.parseMany(cmdlines, 3, [&](auto index, auto & ctx) {
+            nums[index] = ctx[num];
+        });
+        EXPECT(res.size() == cmdlines.size());
+        EXPECT(res[7].parsed && res[7].exitCode == Dim::kExitOk);
+        EXPECT(res[7].command == "go" && nums[7] == 7);
+        EXPECT(nums[999] == 999);
+        EXPECT(!res[500].parsed && res[500].exitCode == Dim::kExitUsage);
+        EXPECT(res[500].errMsg == "Invalid '-n' value: x");
+        EXPECT(res[501].parsed && res[501].errMsg.empty());
+
+        auto res2 = cli.parseMany(
+            vector<vector<string>>{{"a", "-n1"}, {"b", "go", "c"}});
+        EXPECT(res2.size() == 2 && res2[0].parsed && res2[1].parsed);
+        EXPECT(res2[0].command.empty() && res2[1].command == "go");
+        EXPECT(*num == 7);
+
+        for (unsigned threads : {1, 3}) {
+            string what;
+            try {
+                auto fn = [](auto index, auto &) {
+                    if (index == 700)
+                        throw runtime_error("line " + to_string(index));
+                };
+                (void) cli.parseMany(cmdlines, threads, fn);
+            } catch (const runtime_error & e) {
+                what = e.what();
+            }
+            EXPECT(what == "line 700");
+        }
+    }
+
+    // clones share the definition but not the values
+    {
+        auto one = cli.clone();
+        auto two = cli.clone();
+        EXPECT(one.context() && !cli.context());
+        EXPECT(one.parse(cli.toArgv(kCommand + " -n1 --name=bad"s)));
+        auto args = cli.toArgv(kCommand + " -n2 go a b"s);
+        EXPECT(two.exec(args) == Dim::kExitOk);
+        EXPECT(one.commandMatched().empty() && two.commandMatched() == "go");
+        auto & ctx = *one.context();
+        EXPECT(ctx[num] == 1 && ctx[name] == "good");
+        EXPECT((*two.context())[files].size() == 2);
+        {
+            Context::Scope scope(*two.context());
+            EXPECT(*num == 2 && files.size() == 2);
+        }
+        EXPECT(!one.parse(cli.toArgv(kCommand + " -nx"s)));
+        EXPECT(one.errMsg() == "Invalid '-n' value: x");
+        EXPECT(two.exitCode() == Dim::kExitOk);
+        EXPECT(*num == 7 && cli.commandMatched().empty());
+    }
+
+    // cloning a definition that isn't frozen yet freezes it
+    {
+        CliTest lcli;
+        auto & n = lcli.opt<int>("n", 5);
+        EXPECT(!lcli.frozen());
+        auto one = lcli.clone();
+        EXPECT(lcli.frozen() && one.frozen());
+        EXPECT(one.parse(lcli.toArgv(kCommand + " -n3"s)));
+        EXPECT_PARSE(lcli, "-n4");
+        EXPECT((*one.context())[n] == 3 && *n == 4);
+    }
+
+    // options reset lazily between parses
+    {
+        CliTest lcli;
+        lcli.lazyReset();
+        auto & n = lcli.opt<int>("n", 5);
+        auto & strs = lcli.optVec<string>("s").size(1, 2);
+        string color = "none";
+        lcli.opt(&color, "color", "black");
+        auto & shape = lcli.opt<string>("square", "square").flagValue(true);
+        lcli.opt(shape, "circle", "circle").flagValue();
+        auto & alias = lcli.opt(n, "num", 9);
+        EXPECT_PARSE(lcli, "-n1 -s a -s b --color red --circle");
+        EXPECT(*n == 1 && strs.size() == 2 && *shape == "circle");
+        EXPECT(color == "red");
+        EXPECT_PARSE(lcli, "");
+        EXPECT(color == "black");
+        EXPECT(*n == 9 && !n && !alias && !strs && *shape == "square");
+        EXPECT_PARSE(lcli, "-s c");
+        EXPECT(*n == 9 && *strs == vector<string>{"c"});
+        EXPECT_PARSE(lcli, "-s a -s b -s c", false);
+        EXPECT_ERR(lcli, "Error: Too many '-s' values: c\n"
+            "The maximum number of values is 2.\n");
+        EXPECT_PARSE(lcli, "--num 3");
+        EXPECT(*n == 3 && n.from() == "--num" && !strs);
+        EXPECT(lcli.errMsg().empty());
+        lcli.lazyReset(false);
+        *n = 4;
+        EXPECT_PARSE(lcli, "--square");
+        EXPECT(*n == 9 && *shape == "square");
+        lcli.lazyReset();
+        EXPECT_PARSE(lcli, "-n2");
+        EXPECT_PARSE(lcli, "-s d");
+        EXPECT(*n == 9 && strs.size() == 1 && *shape == "square");
+    }
+}
+
+
+/****************************************************************************
+*
+*   Tokenizer reference
+*
+***/
+
+// Char at a time versions of the cli.to*Argv() tokenizers, from before they
+// were changed to scan for special chars in blocks, for differential testing.
+
+//===========================================================================
+static vector<string> refGlibArgv(const string & cmdline) {
+    vector<string> out;
+    const char * cur = cmdline.c_str();
+    const char * last = cur + cmdline.size();
+
+    string arg;
+
+IN_GAP:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\':
+            if (cur < last) {
+                ch = *cur++;
+                if (ch == '\n')
+                    break;
+            }
+            arg += ch;
+            goto IN_UNQUOTED;
+        default: arg += ch; goto IN_UNQUOTED;
+        case '"': goto IN_DQUOTE;
+        case '\'': goto IN_SQUOTE;
+        case '#': goto IN_COMMENT;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '\f':
+        case '\v': break;
+        }
+    }
+    return out;
+
+IN_COMMENT:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\r':
+        case '\n': goto IN_GAP;
+        }
+    }
+    return out;
+
+IN_UNQUOTED:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\':
+            if (cur < last) {
+                ch = *cur++;
+                if (ch == '\n')
+                    break;
+            }
+            arg += ch;
+            break;
+        default: arg += ch; break;
+        case '"': goto IN_DQUOTE;
+        case '\'': goto IN_SQUOTE;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '\f':
+        case '\v':
+            out.push_back(move(arg));
+            arg.clear();
+            goto IN_GAP;
+        }
+    }
+    out.push_back(move(arg));
+    return out;
+
+IN_SQUOTE:
+    while (cur < last) {
+        char ch = *cur++;
+        if (ch == '\'')
+            goto IN_UNQUOTED;
+        arg += ch;
+    }
+    out.push_back(move(arg));
+    return out;
+
+IN_DQUOTE:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '"': goto IN_UNQUOTED;
+        case '\\':
+            if (cur < last) {
+                ch = *cur++;
+                switch (ch) {
+                case '$':
+                case '\'':
+                case '"':
+                case '\\': break;
+                case '\n': continue;
+                default: arg += '\\';
+                }
+            }
+            arg += ch;
+            break;
+        default: arg += ch; break;
+        }
+    }
+    out.push_back(move(arg));
+    return out;
+}
+
+//===========================================================================
+static vector<string> refGnuArgv(const string & cmdline) {
+    vector<string> out;
+    const char * cur = cmdline.c_str();
+    const char * last = cur + cmdline.size();
+
+    string arg;
+    char quote;
+
+IN_GAP:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\':
+            if (cur < last)
+                ch = *cur++;
+            arg += ch;
+            goto IN_UNQUOTED;
+        default: arg += ch; goto IN_UNQUOTED;
+        case '\'':
+        case '"': quote = ch; goto IN_QUOTED;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '\f':
+        case '\v': break;
+        }
+    }
+    return out;
+
+IN_UNQUOTED:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\':
+            if (cur < last)
+                ch = *cur++;
+            arg += ch;
+            break;
+        default: arg += ch; break;
+        case '"':
+        case '\'': quote = ch; goto IN_QUOTED;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '\f':
+        case '\v':
+            out.push_back(move(arg));
+            arg.clear();
+            goto IN_GAP;
+        }
+    }
+    out.push_back(move(arg));
+    return out;
+
+
+IN_QUOTED:
+    while (cur < last) {
+        char ch = *cur++;
+        if (ch == quote)
+            goto IN_UNQUOTED;
+        if (ch == '\\' && cur < last)
+            ch = *cur++;
+        arg += ch;
+    }
+    out.push_back(move(arg));
+    return out;
+}
+
+//===========================================================================
+static vector<string> refWindowsArgv(const string & cmdline) {
+    vector<string> out;
+    const char * cur = cmdline.c_str();
+    const char * last = cur + cmdline.size();
+
+    string arg;
+    int backslashes = 0;
+
+    auto appendBackslashes = [&arg, &backslashes]() {
+        if (backslashes) {
+            arg.append(backslashes, '\\');
+            backslashes = 0;
+        }
+    };
+
+IN_GAP:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\': backslashes += 1; goto IN_UNQUOTED;
+        case '"': goto IN_QUOTED;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n': break;
+        default: arg += ch; goto IN_UNQUOTED;
+        }
+    }
+    return out;
+
+IN_UNQUOTED:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\': backslashes += 1; break;
+        case '"':
+            if (int num = backslashes) {
+                backslashes = 0;
+                arg.append(num / 2, '\\');
+                if (num % 2 == 1) {
+                    arg += ch;
+                    break;
+                }
+            }
+            goto IN_QUOTED;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            appendBackslashes();
+            out.push_back(move(arg));
+            arg.clear();
+            goto IN_GAP;
+        default:
+            appendBackslashes();
+            arg += ch;
+            break;
+        }
+    }
+    appendBackslashes();
+    out.push_back(move(arg));
+    return out;
+
+IN_QUOTED:
+    while (cur < last) {
+        char ch = *cur++;
+        switch (ch) {
+        case '\\': backslashes += 1; break;
+        case '"':
+            if (int num = backslashes) {
+                backslashes = 0;
+                arg.append(num / 2, '\\');
+                if (num % 2 == 1) {
+                    arg += ch;
+                    break;
+                }
+            }
+            goto IN_UNQUOTED;
+        default:
+            appendBackslashes();
+            arg += ch;
+            break;
+        }
+    }
+    appendBackslashes();
+    out.push_back(move(arg));
+    return out;
+}
+
+//===========================================================================
+void tokenizerTests() {
+    int line = 0;
+    CliTest cli;
+
+    // Random command lines, heavy with the chars that are special to at
+    // least one of the tokenizers and with plain runs of every length, so
+    // that the special chars land everywhere within the scanned blocks.
+    const char specials[] = " \t\r\n\f\v\xe9\\\"'#";
+    unsigned seed = 1;
+    auto rand = [&seed](unsigned limit) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % limit;
+    };
+    for (int i = 0; i < 3000; ++i) {
+        string cmdline;
+        auto len = rand(i % 10 ? 40 : 400);
+        while (cmdline.size() < len) {
+            if (rand(3)) {
+                cmdline += specials[rand(sizeof specials - 1)];
+            } else {
+                cmdline.append(rand(40), char('a' + rand(26)));
+            }
+        }
+        EXPECT(cli.toGlibArgv(cmdline) == refGlibArgv(cmdline));
+        EXPECT(cli.toGnuArgv(cmdline) == refGnuArgv(cmdline));
+        EXPECT(cli.toWindowsArgv(cmdline) == refWindowsArgv(cmdline));
+    }
+}
+
+
+/****************************************************************************
+*
+*   Memory allocation
+*
+***/
+
+//===========================================================================
+void allocTests() {
+    int line = 0;
+    CliTest cli;
+
+    // steady state parse doesn't allocate
+    {
+        cli.opt<bool>("v verbose");
+        cli.opt<int>("n count");
+        cli.opt<string>("s");
+        cli.command("go").optVec<double>("[values]");
+        auto args = cli.toArgv(kCommand + " -v --count=1 -s x"s);
+        auto cmdArgs = cli.toArgv(kCommand + " -sy go 1.5 2 3"s);
+        for (auto i = 0; i < 2; ++i) {
+            EXPECT(cli.parse(args));
+            EXPECT(cli.parse(cmdArgs));
+        }
+        size_t allocs = s_allocs;
+        EXPECT(cli.parse(args));
+        EXPECT(cli.parse(cmdArgs));
+        EXPECT(s_allocs == allocs);
+    }
+
+    // memory stats
+    {
+        auto stats = cli.memoryStats();
+        EXPECT(stats.opts == 6); // includes --help of both commands
+        EXPECT(stats.cmds == 2);
+        // options and their proxies share the blocks of the slab
+        EXPECT(stats.options.allocs > 0);
+        EXPECT(stats.options.allocs < 2 * stats.opts);
+        EXPECT(stats.indexes.bytes > 0);
+        EXPECT(stats.parse.bytes > 0);
+        auto total = stats.total();
+        EXPECT(total.bytes == stats.options.bytes + stats.help.bytes
+            + stats.commands.bytes + stats.indexes.bytes + stats.parse.bytes);
+
+        auto desc = string(100, 'x');
+        auto & opt = cli.opt<string>("desc").desc(desc);
+        auto fp = opt.footprint();
+        EXPECT(fp.bytes > sizeof(opt) + desc.size());
+        auto stats2 = cli.memoryStats();
+        EXPECT(stats2.opts == 7);
+        EXPECT(stats2.help.bytes >= stats.help.bytes + desc.size());
+        EXPECT(stats2.help.allocs == stats.help.allocs + 1);
+        EXPECT(stats2.options.bytes > stats.options.bytes);
+    }
+
+    // actions capturing a few references are stored inline, and run in
+    // order by kind regardless of the order they were added
+    {
+        string seq;
+        int * ptr = nullptr;
+        auto small = [&](char ch) {
+            return [&seq, ch, ptr](auto &, auto &, auto &) {
+                seq += ch;
+                return ptr == nullptr;
+            };
+        };
+        auto large = [&](char ch) {
+            return [&seq, ch, ptr, big = ptr](auto &, auto &, auto &) {
+                seq += ch;
+                return ptr == big;
+            };
+        };
+        CliTest acli;
+        auto & opt = acli.opt<int>("act");
+        auto & opt2 = acli.opt<int>("act2");
+        size_t allocs = s_allocs;
+        opt.after(small('a')).check(small('c')).after(small('b'));
+        size_t smallAllocs = s_allocs - allocs;
+        allocs = s_allocs;
+        opt2.after(large('A')).check(large('C')).after(large('B'));
+        EXPECT(s_allocs - allocs == smallAllocs + 3);
+
+        opt.check(small('d'));
+        opt.parse([&seq](auto &, auto & opt, auto & val) {
+            seq += 'p';
+            return opt.fromString(*opt, val);
+        });
+        EXPECT(acli.parse(acli.toArgv(kCommand + " --act=1 --act 2"s)));
+        EXPECT(seq == "pcdpcdabAB");
+    }
+
+    // string values are moved out of args passed by rvalue
+    {
+        CliTest acli;
+        auto & json = acli.opt<string>("json");
+        auto & blobs = acli.optVec<string>("[blobs]");
+        auto & checked = acli.opt<string>("checked").check(
+            [](auto &, auto & opt, auto & val) { return *opt == val; });
+        string big(1000, 'x');
+        auto args = acli.toArgvL(kCommand, "--json", big, big, big);
+        args.push_back("--checked");
+        args.push_back(big);
+        vector<const char *> ptrs;
+        for (auto && arg : args)
+            ptrs.push_back(arg.data());
+        EXPECT(acli.parse(args));
+        EXPECT(*json == big && json->data() != ptrs[2]);
+        EXPECT(acli.parse(move(args)));
+        EXPECT(*json == big && json->data() == ptrs[2]);
+        EXPECT(blobs.size() == 2 && blobs[1].data() == ptrs[4]);
+        EXPECT(*checked == big && checked->data() != ptrs[6]);
+        EXPECT(args[2].empty() && args[6] == big);
+    }
+}
+
+
 /****************************************************************************
 *
 *   Main
@@ -2303,6 +3404,7 @@ static int runTests(bool prompt) {
     helpTextTests();
     cmdTests();
     argvTests();
+    tokenizerTests();
     optCheckTests();
     flagTests();
     responseTests();
@@ -2315,6 +3417,8 @@ static int runTests(bool prompt) {
     beforeTests();
     envTests();
     finalOptTests();
+    contextTests();
+    allocTests();
 
     if (s_errors) {
         cerr << "*** TESTS FAILED ***" << endl;
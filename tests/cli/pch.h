@@ -5,11 +5,13 @@
 
 #include "dimcli/cli.h"
 
+#include <atomic>
 #include <complex>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
 #if defined(_MSC_VER) && _MSC_VER < 1914
 #include <experimental/filesystem>
@@ -12,8 +12,19 @@
 )
 #include "args.h"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #undef NDEBUG
 #include <cassert>
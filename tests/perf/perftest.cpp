@@ -1,4 +1,4 @@
-// Copyright Glen Knowles 2016 - 2021.
+// Copyright Glen Knowles 2016 - 2022.
 // Distributed under the Boost Software License, Version 1.0.
 //
 // perftest.cpp - dimcli test perf
@@ -6,8 +6,239 @@
 #include "pch.h"
 #pragma hdrstop
 
+using namespace std;
 using namespace std::chrono;
 
+
+/****************************************************************************
+*
+*   Tuning parameters
+*
+***/
+
+// Operations are timed in batches that take at least this long, so that the
+// clock resolution doesn't matter.
+const auto kMinSampleTime = 2ms;
+
+
+/****************************************************************************
+*
+*   Variables
+*
+***/
+
+// Calls to, and bytes requested from, global operator new.
+static atomic<size_t> s_allocs;
+static atomic<size_t> s_allocBytes;
+
+
+/****************************************************************************
+*
+*   Allocation counting
+*
+***/
+
+//===========================================================================
+// Every form of global operator new and delete is replaced, so that memory
+// is never allocated by the runtime's version and freed by ours.
+static void * allocMem(size_t size, size_t align = 0) {
+    s_allocs.fetch_add(1, memory_order_relaxed);
+    s_allocBytes.fetch_add(size, memory_order_relaxed);
+    if (!size)
+        size = 1;
+    if (!align)
+        return malloc(size);
+    size = (size + align - 1) / align * align;
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return aligned_alloc(align, size);
+#endif
+}
+
+//===========================================================================
+static void freeMem(void * ptr, size_t align = 0) {
+#ifdef _WIN32
+    if (align)
+        return _aligned_free(ptr);
+#else
+    (void) align;
+#endif
+    free(ptr);
+}
+
+//===========================================================================
+void * operator new(size_t size) {
+    if (auto ptr = allocMem(size))
+        return ptr;
+    throw bad_alloc();
+}
+
+//===========================================================================
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+//===========================================================================
+void * operator new(size_t size, const nothrow_t &) noexcept {
+    return allocMem(size);
+}
+
+//===========================================================================
+void * operator new[](size_t size, const nothrow_t &) noexcept {
+    return allocMem(size);
+}
+
+//===========================================================================
+void operator delete(void * ptr) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete[](void * ptr) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete(void * ptr, size_t) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, size_t) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete(void * ptr, const nothrow_t &) noexcept {
+    freeMem(ptr);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, const nothrow_t &) noexcept {
+    freeMem(ptr);
+}
+
+#ifdef __cpp_aligned_new
+
+//===========================================================================
+void * operator new(size_t size, align_val_t align) {
+    if (auto ptr = allocMem(size, (size_t) align))
+        return ptr;
+    throw bad_alloc();
+}
+
+//===========================================================================
+void * operator new[](size_t size, align_val_t align) {
+    return operator new(size, align);
+}
+
+//===========================================================================
+void * operator new(
+    size_t size,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    return allocMem(size, (size_t) align);
+}
+
+//===========================================================================
+void * operator new[](
+    size_t size,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    return allocMem(size, (size_t) align);
+}
+
+//===========================================================================
+void operator delete(void * ptr, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete(void * ptr, size_t, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete[](void * ptr, size_t, align_val_t align) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete(
+    void * ptr,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+//===========================================================================
+void operator delete[](
+    void * ptr,
+    align_val_t align,
+    const nothrow_t &
+) noexcept {
+    freeMem(ptr, (size_t) align);
+}
+
+#endif
+
+
+/****************************************************************************
+*
+*   Declarations
+*
+***/
+
+namespace {
+
+struct Bench {
+    string name;
+    // Called once before the case is timed, returns the operation to time.
+    function<function<void()>()> setup;
+};
+
+struct Result {
+    string name;
+    size_t batch;           // operations per sample
+    vector<double> samples; // nanoseconds per operation, sorted
+    double allocs;          // operator new calls per operation
+    double allocBytes;      // bytes requested per operation
+};
+
+// Size of a generated command line interface.
+struct Shape {
+    unsigned options;   // in total, spread over top level and commands
+    unsigned aliases;   // additional long names per option
+    unsigned commands;
+    unsigned groups;    // option groups per command
+    unsigned choices;   // per option that takes a choice
+};
+
+struct Synthetic {
+    shared_ptr<Dim::CliLocal> cli;
+    vector<string> args;    // uses the command and all of its options
+    string cmd;             // command used by args, empty if none
+    Dim::Cli::Opt<bool> * first;
+};
+
+} // namespace
+
+
+/****************************************************************************
+*
+*   Helpers
+*
+***/
+
 //===========================================================================
 static bool doubleequals(const double a, const double b) {
     static const double delta = 0.0001;
@@ -16,89 +247,907 @@ static bool doubleequals(const double a, const double b) {
 }
 
 //===========================================================================
-int main(int argc, char * argv[]) {
-    Dim::Cli cli;
-    auto & test = cli.opt("test", false).desc("Run tests.");
-    if (!cli.parse(argc, argv))
-        return cli.printError(std::cerr);
-    if (*test) {
-        std::cout << "Run from automated testing framework, quick exit.";
-        return 0;
+// Arguments of the original args.h comparison.
+static vector<string> compareArgs(bool withProgName) {
+    vector<string> out;
+    if (withProgName)
+        out.push_back("progname");
+    out.insert(out.end(), {"-i", "7", "-c", "a", "2.7", "--char", "b", "8.4",
+        "-c", "c", "8.8", "--char", "d"});
+    for (int i = 0; i < 1000; ++i)
+        out.push_back("7");
+    return out;
+}
+
+//===========================================================================
+// Command line that exercises quoting and escaping of all the tokenizers.
+static string tokenizerCmdline() {
+    string out;
+    for (int i = 0; i < 100; ++i) {
+        out += "--opt" + to_string(i) + "=value ";
+        out += "\"quoted arg\" ";
+        out += "'single quoted' ";
+        out += "escaped\\ space ";
+        out += "back\\\\slash\\\"quote ";
     }
+    return out;
+}
+
+//===========================================================================
+// Defines a command line interface with options of assorted types, aliases,
+// choices, and groups spread round robin over the top level and commands.
+static Synthetic makeSynthetic(const Shape & shape) {
+    Synthetic out;
+    out.cli = make_shared<Dim::CliLocal>();
+    auto & cli = *out.cli;
+    out.first = nullptr;
+    for (unsigned x = 0; x < shape.commands; ++x)
+        cli.command("cmd-" + to_string(x)).desc("Command " + to_string(x));
+    if (shape.commands)
+        out.cmd = "cmd-" + to_string(shape.commands / 2);
 
-    std::vector<std::string> carguments({"-i", "7", "-c", "a", "2.7",
-        "--char", "b", "8.4", "-c", "c", "8.8", "--char", "d"});
-    std::vector<std::string> pcarguments({"progname", "-i", "7",
-        "-c", "a", "2.7", "--char", "b", "8.4", "-c", "c", "8.8",
-        "--char", "d"});
-    for (int i = 0; i < 1000; ++i) {
-        carguments.push_back("7");
-        pcarguments.push_back("7");
+    vector<string> top;
+    vector<string> sub;
+    for (unsigned x = 0; x < shape.options; ++x) {
+        auto num = to_string(x);
+        auto name = "opt-" + num;
+        auto names = name;
+        for (unsigned a = 0; a < shape.aliases; ++a)
+            names += " " + name + "-a" + to_string(a);
+        auto cmdNum = x % (shape.commands + 1);
+        auto cmd = cmdNum ? "cmd-" + to_string(cmdNum - 1) : string();
+        auto group = shape.groups
+            ? "group-" + to_string(x / (shape.commands + 1) % shape.groups)
+            : string();
+        auto & args = cmd.empty() ? top : sub;
+        auto used = cmd == out.cmd;
+        switch (x % 4) {
+        case 0: {
+            auto & opt = cli.opt<bool>(names).command(cmd).group(group)
+                .desc("Flag " + num);
+            if (!out.first)
+                out.first = &opt;
+            if (used)
+                args.push_back("--" + name);
+            break;
+        }
+        case 1:
+            cli.opt<int>(names).command(cmd).group(group)
+                .desc("Number " + num);
+            if (used)
+                args.push_back("--" + name + "=" + num);
+            break;
+        case 2:
+            cli.opt<string>(names).command(cmd).group(group)
+                .desc("String " + num);
+            if (used) {
+                args.push_back("--" + (shape.aliases ? name + "-a0" : name));
+                args.push_back("value");
+            }
+            break;
+        case 3: {
+            auto & opt = cli.opt<string>(names).command(cmd).group(group)
+                .desc("Choice " + num);
+            for (unsigned c = 0; c < shape.choices; ++c) {
+                auto val = "choice-" + to_string(c);
+                opt.choice(val, val, "Choice " + to_string(c) + ".");
+            }
+            if (used && shape.choices) {
+                args.push_back(
+                    "--" + name + "=choice-" + to_string(shape.choices - 1)
+                );
+            }
+            break;
+        }
+        }
     }
 
-    // args
-    {
-        high_resolution_clock::time_point start = high_resolution_clock::now();
-        args::ArgumentParser parser(
+    out.args.push_back("progname");
+    out.args.insert(out.args.end(), top.begin(), top.end());
+    if (!out.cmd.empty())
+        out.args.push_back(out.cmd);
+    out.args.insert(out.args.end(), sub.begin(), sub.end());
+    return out;
+}
+
+//===========================================================================
+static double percentile(const vector<double> & sorted, double pct) {
+    auto pos = (size_t) (pct * (sorted.size() - 1) + 0.5);
+    return sorted[pos];
+}
+
+
+/****************************************************************************
+*
+*   Benchmarks
+*
+***/
+
+//===========================================================================
+static vector<Bench> makeBenches() {
+    vector<Bench> out;
+
+    // args.h parsing the same command line as parse/compare, for reference.
+    out.push_back({"args.h/compare", [] {
+        auto parser = make_shared<args::ArgumentParser>(
             "This is a test program.",
             "This goes after the options."
         );
-        args::ValueFlag<int> integer(parser, "integer",
-            "The integer flag", {'i', "int"});
-        args::ValueFlagList<char> characters(parser, "characters",
-            "The character flag", {'c', "char"});
-        args::PositionalList<double> numbers(parser, "numbers",
-            "The numbers position list");
-        std::vector<std::string> arguments(carguments);
-        for (int x = 0; x < 10'000; ++x)
-        {
-            parser.ParseArgs(arguments);
-            const int i = args::get(integer);
-            std::vector<char> const c(args::get(characters));
-            std::vector<double> const n(args::get(numbers));
+        auto integer = make_shared<args::ValueFlag<int>>(*parser, "integer",
+            "The integer flag", args::Matcher{'i', "int"});
+        auto characters = make_shared<args::ValueFlagList<char>>(*parser,
+            "characters", "The character flag", args::Matcher{'c', "char"});
+        auto numbers = make_shared<args::PositionalList<double>>(*parser,
+            "numbers", "The numbers position list");
+        auto arguments = make_shared<vector<string>>(compareArgs(false));
+        return [=] {
+            parser->ParseArgs(*arguments);
+            const int i = args::get(*integer);
+            vector<char> const c(args::get(*characters));
+            vector<double> const n(args::get(*numbers));
             assert(i == 7);
-            assert(c[0] == 'a');
-            assert(c[1] == 'b');
-            assert(c[2] == 'c');
-            assert(c[3] == 'd');
+            assert(c[0] == 'a' && c[1] == 'b' && c[2] == 'c' && c[3] == 'd');
             assert(doubleequals(n[0], 2.7));
             assert(doubleequals(n[1], 8.4));
             assert(doubleequals(n[2], 8.8));
-        }
-        auto runtime = high_resolution_clock::now() - start;
-        std::cout << "args seconds to run: "
-            << duration_cast<duration<double>>(runtime).count() << std::endl;
-    }
-    // dimcli
-    {
-        auto start = high_resolution_clock::now();
-        Dim::CliLocal cli;
-        cli.desc("This is a test program.");
-        cli.footer("This goes after the options.");
-        auto & i = cli.opt<int>("i int").valueDesc("integer")
+        };
+    }});
+
+    // dimcli parsing the same command line as args.h/compare.
+    out.push_back({"parse/compare", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        cli->desc("This is a test program.");
+        cli->footer("This goes after the options.");
+        auto & i = cli->opt<int>("i int").valueDesc("integer")
             .desc("The integer flag");
-        auto & c = cli.optVec<char>("c char").valueDesc("characters")
+        auto & c = cli->optVec<char>("c char").valueDesc("characters")
             .desc("The character flag");
-        auto & n = cli.optVec<double>("[numbers]")
+        auto & n = cli->optVec<double>("[numbers]")
             .desc("The numbers position list");
-        std::vector<std::string> arguments(pcarguments);
-        for (int x = 0; x < 10'000; ++x)
-        {
-            bool result = cli.parse(arguments);
+        auto arguments = make_shared<vector<string>>(compareArgs(true));
+        return [=, &i, &c, &n] {
+            bool result = cli->parse(*arguments);
             assert(result == true);
             assert(*i == 7);
-            assert(c[0] == 'a');
-            assert(c[1] == 'b');
-            assert(c[2] == 'c');
-            assert(c[3] == 'd');
+            assert(c[0] == 'a' && c[1] == 'b' && c[2] == 'c' && c[3] == 'd');
             assert(doubleequals(n[0], 2.7));
             assert(doubleequals(n[1], 8.4));
             assert(doubleequals(n[2], 8.8));
+        };
+    }});
+
+    // Same as parse/compare, but parsing directly from argv.
+    out.push_back({"parse/argv", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        auto & i = cli->opt<int>("i int");
+        cli->optVec<char>("c char");
+        auto & n = cli->optVec<double>("[numbers]");
+        auto arguments = make_shared<vector<string>>(compareArgs(true));
+        auto argv = make_shared<vector<char *>>();
+        for (auto && arg : *arguments)
+            argv->push_back(arg.data());
+        // Also capture arguments, argv points into it.
+        return [cli, arguments, argv, &i, &n] {
+            bool result = cli->parse(argv->size(), argv->data());
+            assert(result == true);
+            assert(*i == 7);
+            assert(n.size() == 1003);
+        };
+    }});
+
+    // Many options and a short command line, so that finding the options
+    // is dominated by the option index. Once with the index cached across
+    // parses and again with it rebuilt by every parse.
+    for (auto rebuild : {false, true}) {
+        auto name = rebuild
+            ? "parse/index 500 rebuilt"
+            : "parse/index 500 cached";
+        out.push_back({name, [=] {
+            auto cli = make_shared<Dim::CliLocal>();
+            for (int x = 0; x < 500; ++x) {
+                auto num = to_string(x);
+                cli->opt<bool>("flag" + num + " f" + num);
+            }
+            auto & last = cli->opt<bool>("last");
+            auto arguments = make_shared<vector<string>>(
+                vector<string>{"progname", "--flag250", "--last"}
+            );
+            return [=, &last] {
+                // Changing the command, even to the same one, invalidates
+                // the cached index.
+                if (rebuild)
+                    last.command({});
+                bool result = cli->parse(*arguments);
+                assert(result == true);
+                assert(*last);
+            };
+        }});
+    }
+
+    // Options only, of assorted types and styles, also with phase timing
+    // enabled to show its overhead.
+    for (auto timing : {false, true}) {
+        auto name = timing ? "parse/options timed" : "parse/options";
+        out.push_back({name, [=] {
+            auto cli = make_shared<Dim::CliLocal>();
+            cli->phaseTiming(timing);
+            auto arguments = make_shared<vector<string>>();
+            arguments->push_back("progname");
+            for (int x = 0; x < 10; ++x) {
+                auto num = to_string(x);
+                cli->opt<int>("i" + num + " int" + num);
+                cli->opt<string>("string" + num);
+                cli->opt<double>("double" + num);
+                cli->opt<bool>("flag" + num);
+                arguments->insert(arguments->end(), {"--int" + num + "=" + num,
+                    "--string" + num, "text", "--double" + num + "=1.5",
+                    "--no-flag" + num});
+            }
+            return [=] {
+                bool result = cli->parse(*arguments);
+                assert(result == true);
+            };
+        }});
+    }
+
+    // Operands only.
+    out.push_back({"parse/operands", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        auto & first = cli->opt<string>("<first>");
+        auto & rest = cli->optVec<int>("[rest]");
+        auto arguments = make_shared<vector<string>>();
+        arguments->push_back("progname");
+        arguments->push_back("first");
+        for (int x = 0; x < 1000; ++x)
+            arguments->push_back(to_string(x));
+        return [=, &first, &rest] {
+            bool result = cli->parse(*arguments);
+            assert(result == true);
+            assert(*first == "first" && rest.size() == 1000);
+        };
+    }});
+    out.push_back({"parse/operands 100k", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        auto & vals = cli->optVec<int>("[values]");
+        auto arguments = make_shared<vector<string>>();
+        arguments->push_back("progname");
+        for (int x = 0; x < 100'000; ++x)
+            arguments->push_back(to_string(x));
+        return [=, &vals] {
+            bool result = cli->parse(*arguments);
+            assert(result == true);
+            assert(vals.size() == 100'000);
+        };
+    }});
+
+    // Reparsing a short command line with many options defined, such as in
+    // a REPL, with and without lazy reset.
+    for (auto lazy : {false, true}) {
+        auto name = lazy ? "parse/reparse 2000 lazy"s : "parse/reparse 2000"s;
+        out.push_back({name, [lazy] {
+            auto cli = make_shared<Dim::CliLocal>();
+            cli->lazyReset(lazy);
+            for (int x = 0; x < 2000; ++x)
+                cli->opt<string>("opt" + to_string(x), "default");
+            auto & num = cli->opt<int>("n", 0);
+            auto arguments = make_shared<vector<string>>();
+            arguments->insert(arguments->end(), {"progname", "-n", "1"});
+            return [=, &num] {
+                bool result = cli->parse(*arguments);
+                assert(result == true && *num == 1);
+            };
+        }});
+    }
+
+    // Bundled short flags.
+    out.push_back({"parse/bundled", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        string bundle = "-";
+        for (char ch = 'a'; ch <= 'z'; ++ch) {
+            cli->optVec<bool>(string(1, ch));
+            bundle += ch;
+        }
+        auto arguments = make_shared<vector<string>>();
+        arguments->push_back("progname");
+        for (int x = 0; x < 100; ++x)
+            arguments->push_back(bundle);
+        return [=] {
+            bool result = cli->parse(*arguments);
+            assert(result == true);
+        };
+    }});
+
+    // Subcommand selected from many.
+    out.push_back({"parse/subcommand", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        cli->opt<bool>("v verbose");
+        for (int x = 0; x < 20; ++x) {
+            auto cmd = "cmd" + to_string(x);
+            cli->command(cmd).opt<int>("n number");
+            cli->command(cmd).opt<string>("name");
+            cli->command(cmd).optVec<string>("[files]");
+        }
+        auto arguments = make_shared<vector<string>>(vector<string>{
+            "progname", "-v", "cmd10", "-n5", "--name=x", "a", "b", "c"});
+        return [=] {
+            bool result = cli->parse(*arguments);
+            assert(result == true);
+            assert(cli->commandMatched() == "cmd10");
+        };
+    }});
+
+    // Hundreds of long options.
+    out.push_back({"parse/long options", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        auto arguments = make_shared<vector<string>>();
+        arguments->push_back("progname");
+        for (int x = 0; x < 500; ++x) {
+            auto name = "option-" + to_string(x);
+            cli->opt<int>(name);
+            arguments->push_back("--" + name + "=" + to_string(x));
+            arguments->push_back("--" + name);
+            arguments->push_back(to_string(x));
+        }
+        return [=] {
+            bool result = cli->parse(*arguments);
+            assert(result == true);
+        };
+    }});
+
+    // Response file with lots of arguments, removed when the case is done.
+    // With and without it being cached.
+    for (auto cached : {false, true}) {
+        auto name = cached ? "parse/response file cached"s
+            : "parse/response file"s;
+        out.push_back({name, [cached] {
+            auto fn = shared_ptr<const char>(
+                "dimcli-perf.rsp",
+                [](const char * name) { remove(name); }
+            );
+            {
+                ofstream f(fn.get());
+                for (int x = 0; x < 1000; ++x)
+                    f << "--value " << x << " \"operand " << x << "\"\n";
+            }
+            auto cli = make_shared<Dim::CliLocal>();
+            if (cached) {
+                cli->responseFileCache(
+                    make_shared<Dim::Cli::ResponseFileCache>());
+            }
+            auto & vals = cli->optVec<int>("value");
+            auto & oprs = cli->optVec<string>("[operands]");
+            auto arg = "@"s + fn.get();
+            return [cli, fn, arg, &vals, &oprs] {
+                vector<string> arguments = {"progname", arg};
+                bool result = cli->parse(arguments);
+                assert(result == true);
+                assert(vals.size() == 1000 && oprs.size() == 1000);
+            };
+        }});
+    }
+    out.push_back({"parse/response file 100k", [] {
+        auto fn = shared_ptr<const char>(
+            "dimcli-perf-large.rsp",
+            [](const char * name) { remove(name); }
+        );
+        {
+            ofstream f(fn.get());
+            for (int x = 0; x < 100'000; ++x)
+                f << "--value " << x << " \"operand " << x << "\"\n";
+        }
+        auto cli = make_shared<Dim::CliLocal>();
+        auto & vals = cli->optVec<int>("value");
+        auto & oprs = cli->optVec<string>("[operands]");
+        auto arg = "@"s + fn.get();
+        return [cli, fn, arg, &vals, &oprs] {
+            vector<string> arguments = {"progname", arg};
+            bool result = cli->parse(arguments);
+            assert(result == true);
+            assert(vals.size() == 100'000 && oprs.size() == 100'000);
+        };
+    }});
+
+    // Many response files of 1000 args each, followed by as many plain
+    // args as are in all the files. Time should grow linearly with the
+    // number of files. Also with the files loaded by four threads.
+    vector<pair<int, unsigned>> shapes = {{100, 1}, {1000, 1}, {100, 4}};
+    for (auto && shape : shapes) {
+        auto files = shape.first;
+        auto threads = shape.second;
+        auto name = "parse/response files " + to_string(files) + "x1000";
+        if (threads != 1)
+            name += " threads " + to_string(threads);
+        out.push_back({name, [files, threads] {
+            auto names = shared_ptr<vector<string>>(
+                new vector<string>,
+                [](vector<string> * names) {
+                    for (auto && name : *names)
+                        remove(name.c_str());
+                    delete names;
+                }
+            );
+            auto arguments = make_shared<vector<string>>();
+            arguments->push_back("progname");
+            for (int x = 0; x < files; ++x) {
+                names->push_back("dimcli-perf-" + to_string(x) + ".rsp");
+                ofstream f(names->back());
+                for (int y = 0; y < 1000; ++y)
+                    f << "arg" << y << '\n';
+                arguments->push_back("@" + names->back());
+            }
+            for (int x = 0; x < files * 1000; ++x)
+                arguments->push_back("tail");
+            auto cli = make_shared<Dim::CliLocal>();
+            cli->responseFileThreads(threads);
+            auto & args = cli->optVec<string>("[args]");
+            return [cli, names, arguments, files, &args] {
+                bool result = cli->parse(vector<string>(*arguments));
+                assert(result == true);
+                assert(args.size() == (size_t) files * 2000);
+            };
+        }});
+    }
+
+    // Batch of command lines parsed by parseMany with different numbers of
+    // threads, to show how throughput scales with cores.
+    for (auto threads : {1u, 2u, 4u, 8u}) {
+        auto name = "parseMany/threads " + to_string(threads);
+        out.push_back({name, [=] {
+            auto cli = make_shared<Dim::CliLocal>();
+            cli->opt<bool>("v verbose");
+            cli->opt<int>("n number");
+            cli->opt<string>("name");
+            cli->command("go").optVec<string>("[files]");
+            auto cmdlines = make_shared<vector<string>>();
+            for (int x = 0; x < 4096; ++x) {
+                auto num = to_string(x);
+                cmdlines->push_back("progname -v -n" + num + " --name=x" + num
+                    + " go a" + num + " b c");
+            }
+            return [=] {
+                auto res = cli->parseMany(*cmdlines, threads);
+                assert(res.size() == cmdlines->size() && res[0].parsed);
+            };
+        }});
+    }
+
+    // Tokenizing command lines.
+    out.push_back({"tokenize/gnu", [] {
+        auto cmdline = make_shared<string>(tokenizerCmdline());
+        return [=] {
+            auto args = Dim::Cli::toGnuArgv(*cmdline);
+            assert(!args.empty());
+        };
+    }});
+    out.push_back({"tokenize/glib", [] {
+        auto cmdline = make_shared<string>(tokenizerCmdline());
+        return [=] {
+            auto args = Dim::Cli::toGlibArgv(*cmdline);
+            assert(!args.empty());
+        };
+    }});
+    out.push_back({"tokenize/windows", [] {
+        auto cmdline = make_shared<string>(tokenizerCmdline());
+        return [=] {
+            auto args = Dim::Cli::toWindowsArgv(*cmdline);
+            assert(!args.empty());
+        };
+    }});
+
+    // Response file of a large build, one long argument per line.
+    out.push_back({"tokenize/gnu response file", [] {
+        auto content = make_shared<string>();
+        for (int i = 0; i < 100'000; ++i) {
+            *content += "-I/usr/local/include/project/module" + to_string(i)
+                + "/src\n";
+        }
+        return [=] {
+            auto args = Dim::Cli::toGnuArgv(*content);
+            assert(args.size() == 100'000);
+        };
+    }});
+
+    // Rendering help text.
+    out.push_back({"help/printHelp", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        cli->maxWidth(80);
+        cli->header("Header text for the benchmark.");
+        cli->desc("Description of what the benchmark program does, long "
+            "enough that it has to be wrapped across multiple lines.");
+        for (int x = 0; x < 30; ++x) {
+            auto num = to_string(x);
+            cli->group(x < 15 ? "First" : "Second");
+            cli->opt<int>("n" + num + " number" + num)
+                .desc("Number option " + num + " with a description.");
+            cli->opt<bool>("flag" + num).desc("Flag option " + num + ".");
+        }
+        cli->opt<string>("[file]").desc("File to process.");
+        return [=] {
+            ostringstream os;
+            cli->printHelp(os);
+            assert(!os.str().empty());
+        };
+    }});
+
+    // Error paths.
+    out.push_back({"error/unknown option", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        cli->opt<int>("n number");
+        auto arguments = make_shared<vector<string>>(
+            vector<string>{"progname", "-n1", "--unknown"});
+        return [=] {
+            bool result = cli->parse(*arguments);
+            assert(result == false);
+        };
+    }});
+    out.push_back({"error/missing value", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        cli->opt<int>("n number");
+        auto arguments = make_shared<vector<string>>(
+            vector<string>{"progname", "--number"});
+        return [=] {
+            bool result = cli->parse(*arguments);
+            assert(result == false);
+        };
+    }});
+    out.push_back({"error/invalid value", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        cli->opt<int>("n number").range(1, 10);
+        auto arguments = make_shared<vector<string>>(
+            vector<string>{"progname", "--number=11"});
+        return [=] {
+            bool result = cli->parse(*arguments);
+            assert(result == false);
+        };
+    }});
+
+    // Creating and defining cli instances.
+    out.push_back({"startup/CliLocal", [] {
+        return [] {
+            Dim::CliLocal cli;
+        };
+    }});
+    out.push_back({"startup/clone 800", [] {
+        auto cli = make_shared<Dim::CliLocal>();
+        for (int x = 0; x < 800; ++x)
+            cli->opt<int>("option-" + to_string(x));
+        cli->freeze();
+        return [=] {
+            auto clone = cli->clone();
+        };
+    }});
+    out.push_back({"startup/parse", [] {
+        return [] {
+            Dim::CliLocal cli;
+            cli.opt<int>("i int");
+            cli.opt<double>("d dbl");
+            cli.opt<string>("s str");
+            bool result = cli.parse({"progname", "-s", "text"});
+            assert(result == true);
+        };
+    }});
+    out.push_back({"startup/parse numbers", [] {
+        return [] {
+            Dim::CliLocal cli;
+            auto & i = cli.opt<int>("i int");
+            cli.opt<double>("d dbl");
+            cli.opt<string>("s str");
+            bool result = cli.parse({"progname", "-i", "7", "-d", "2.5"});
+            assert(result == true);
+            assert(*i == 7);
+        };
+    }});
+    out.push_back({"startup/define 800", [] {
+        auto names = make_shared<vector<string>>();
+        for (int x = 0; x < 800; ++x)
+            names->push_back("option-" + to_string(x));
+        return [=] {
+            Dim::CliLocal cli;
+            for (auto && name : *names)
+                cli.opt<int>(name);
+        };
+    }});
+    out.push_back({"startup/define 2000 bound", [] {
+        auto names = make_shared<vector<string>>();
+        for (int x = 0; x < 2000; ++x)
+            names->push_back("option-" + to_string(x));
+        auto vals = make_shared<vector<int>>(names->size());
+        return [=] {
+            Dim::CliLocal cli;
+            for (size_t x = 0; x < names->size(); ++x)
+                cli.opt(&(*vals)[x], (*names)[x]);
+        };
+    }});
+
+    return out;
+}
+
+//===========================================================================
+// Benchmarks of interfaces generated with steps number of shapes, each twice
+// the size of the one before it and ending with the one given.
+static vector<Bench> makeScaleBenches(const Shape & shape, unsigned steps) {
+    vector<Bench> out;
+    for (unsigned step = steps; step-- > 0;) {
+        auto sized = shape;
+        sized.options >>= step;
+        sized.commands >>= step;
+        sized.groups >>= step;
+        auto prefix = "scale/" + to_string(sized.options) + "x"
+            + to_string(sized.commands) + "/";
+
+        out.push_back({prefix + "define", [=] {
+            return [=] { makeSynthetic(sized); };
+        }});
+        out.push_back({prefix + "first parse", [=] {
+            auto syn = make_shared<Synthetic>(makeSynthetic(sized));
+            return [=] {
+                // Changing the command, even to the same one, invalidates the
+                // cached index, so every parse rebuilds it.
+                if (syn->first)
+                    syn->first->command({});
+                bool result = syn->cli->parse(syn->args);
+                assert(result == true);
+            };
+        }});
+        out.push_back({prefix + "parse", [=] {
+            auto syn = make_shared<Synthetic>(makeSynthetic(sized));
+            return [=] {
+                bool result = syn->cli->parse(syn->args);
+                assert(result == true);
+            };
+        }});
+        out.push_back({prefix + "printHelp", [=] {
+            auto syn = make_shared<Synthetic>(makeSynthetic(sized));
+            return [=] {
+                ostringstream os;
+                syn->cli->printHelp(os, "progname", syn->cmd);
+                assert(os.tellp() > 0);
+            };
+        }});
+        out.push_back({prefix + "printUsageEx", [=] {
+            auto syn = make_shared<Synthetic>(makeSynthetic(sized));
+            return [=] {
+                ostringstream os;
+                syn->cli->printUsageEx(os, "progname", syn->cmd);
+                assert(os.tellp() > 0);
+            };
+        }});
+    }
+    return out;
+}
+
+
+/****************************************************************************
+*
+*   Running
+*
+***/
+
+//===========================================================================
+static Result run(const Bench & bench, unsigned warmups, unsigned reps) {
+    Result out;
+    out.name = bench.name;
+    auto fn = bench.setup();
+
+    // Find a batch size big enough for the clock resolution.
+    out.batch = 1;
+    for (;;) {
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < out.batch; ++i)
+            fn();
+        if (steady_clock::now() - start >= kMinSampleTime)
+            break;
+        out.batch *= 2;
+    }
+
+    out.samples.reserve(reps);
+    size_t allocs = 0;
+    size_t allocBytes = 0;
+    for (unsigned rep = 0; rep < warmups + reps; ++rep) {
+        auto startAllocs = s_allocs.load();
+        auto startBytes = s_allocBytes.load();
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < out.batch; ++i)
+            fn();
+        auto elapsed = duration<double, nano>(steady_clock::now() - start);
+        if (rep >= warmups) {
+            out.samples.push_back(elapsed.count() / out.batch);
+            allocs += s_allocs - startAllocs;
+            allocBytes += s_allocBytes - startBytes;
         }
-        auto runtime = high_resolution_clock::now() - start;
-        std::cout << "dimcli seconds to run: "
-            << duration_cast<duration<double>>(runtime).count() << std::endl;
     }
+    sort(out.samples.begin(), out.samples.end());
+    out.allocs = (double) allocs / reps / out.batch;
+    out.allocBytes = (double) allocBytes / reps / out.batch;
+    return out;
+}
+
+//===========================================================================
+static void writeTextHeader(ostream & os) {
+    os << left << setw(28) << "benchmark"
+        << right << setw(14) << "median (ns)"
+        << setw(14) << "p99 (ns)"
+        << setw(10) << "allocs"
+        << setw(10) << "batch" << endl;
+}
+
+//===========================================================================
+static void writeText(ostream & os, const Result & res) {
+    os << left << setw(28) << res.name << right << fixed << setprecision(0)
+        << setw(14) << percentile(res.samples, 0.5)
+        << setw(14) << percentile(res.samples, 0.99)
+        << setw(10) << setprecision(1) << res.allocs
+        << setw(10) << res.batch << endl;
+}
+
+//===========================================================================
+static void writeJson(
+    ostream & os,
+    const vector<Result> & results,
+    unsigned warmups,
+    unsigned reps
+) {
+    os << "{\n"
+        << "  \"warmups\": " << warmups << ",\n"
+        << "  \"reps\": " << reps << ",\n"
+        << "  \"benchmarks\": [";
+    for (auto && res : results) {
+        os << (&res == results.data() ? "\n" : ",\n")
+            << "    {\"name\": \"" << res.name << "\""
+            << fixed << setprecision(1)
+            << ", \"batch\": " << res.batch
+            << ", \"min_ns\": " << res.samples.front()
+            << ", \"median_ns\": " << percentile(res.samples, 0.5)
+            << ", \"p99_ns\": " << percentile(res.samples, 0.99)
+            << ", \"max_ns\": " << res.samples.back()
+            << ", \"allocs_per_op\": " << res.allocs
+            << ", \"bytes_per_op\": " << res.allocBytes
+            << "}";
+    }
+    os << "\n  ]\n}\n";
+}
+
 
+/****************************************************************************
+*
+*   Footprint
+*
+***/
+
+//===========================================================================
+// Compares the memory the library reports for generated interfaces with
+// what was allocated while defining them.
+static void writeFootprints(
+    ostream & os,
+    const Shape & shape,
+    unsigned steps
+) {
+    os << left << setw(16) << "interface" << right
+        << setw(7) << "opts"
+        << setw(11) << "options"
+        << setw(11) << "help"
+        << setw(11) << "commands"
+        << setw(11) << "indexes"
+        << setw(11) << "parse"
+        << setw(11) << "total"
+        << setw(9) << "per opt"
+        << setw(11) << "allocated"
+        << setw(9) << "allocs" << endl;
+    for (unsigned step = steps; step-- > 0;) {
+        auto sized = shape;
+        sized.options >>= step;
+        sized.commands >>= step;
+        sized.groups >>= step;
+
+        auto startAllocs = s_allocs.load();
+        auto startBytes = s_allocBytes.load();
+        auto syn = makeSynthetic(sized);
+        auto allocs = s_allocs - startAllocs;
+        auto allocBytes = s_allocBytes - startBytes;
+        bool result = syn.cli->parse(syn.args);
+        assert(result == true);
+
+        auto stats = syn.cli->memoryStats();
+        auto total = stats.total();
+        os << left << setw(16)
+            << to_string(sized.options) + "x" + to_string(sized.commands)
+            << right
+            << setw(7) << stats.opts
+            << setw(11) << stats.options.bytes
+            << setw(11) << stats.help.bytes
+            << setw(11) << stats.commands.bytes
+            << setw(11) << stats.indexes.bytes
+            << setw(11) << stats.parse.bytes
+            << setw(11) << total.bytes
+            << setw(9) << total.bytes / stats.opts
+            << setw(11) << allocBytes
+            << setw(9) << allocs << endl;
+    }
+}
+
+
+/****************************************************************************
+*
+*   Main
+*
+***/
+
+//===========================================================================
+int main(int argc, char * argv[]) {
+    Dim::Cli cli;
+    auto & test = cli.opt<bool>("test").desc("Run tests.");
+    auto & warmups = cli.opt<unsigned>("warmup", 3)
+        .desc("Samples to take and discard before measuring.");
+    auto & reps = cli.opt<unsigned>("reps", 30).clamp(1, 1'000'000)
+        .desc("Samples to take of each benchmark.");
+    auto & json = cli.opt<string>("json").valueDesc("FILE")
+        .desc("Write results as JSON to file, '-' for stdout.");
+    auto & list = cli.opt<bool>("list").desc("List benchmarks and exit.");
+    auto & scale = cli.opt<bool>("scale")
+        .desc("Run benchmarks of generated interfaces of increasing size "
+            "instead of the standard ones.");
+    auto & steps = cli.opt<unsigned>("steps", 5).clamp(1, 16)
+        .desc("Number of sizes, each twice the one before it.");
+    Shape shape;
+    cli.opt(&shape.options, "options", 2000)
+        .desc("Options, in total, of the largest generated interface.");
+    cli.opt(&shape.aliases, "aliases", 1)
+        .desc("Additional long names of each generated option.");
+    cli.opt(&shape.commands, "commands", 150)
+        .desc("Commands of the largest generated interface.");
+    cli.opt(&shape.groups, "groups", 10)
+        .desc("Option groups per command of the largest generated interface.");
+    cli.opt(&shape.choices, "choices", 8)
+        .desc("Choices of each generated option that takes a choice.");
+    auto & footprint = cli.opt<bool>("footprint")
+        .desc("Report memory used by generated interfaces and exit.");
+    auto & names = cli.optVec<string>("[name]")
+        .desc("Run only benchmarks whose names start with one of these.");
+    if (!cli.parse(cerr, argc, argv))
+        return cli.exitCode();
+    if (*test) {
+        cout << "Run from automated testing framework, quick exit.";
+        return 0;
+    }
+
+    if (*footprint) {
+        writeFootprints(cout, shape, *steps);
+        return 0;
+    }
+
+    auto text = !*list && *json != "-";
+    if (text)
+        writeTextHeader(cout);
+    vector<Result> results;
+    auto benches = *scale ? makeScaleBenches(shape, *steps) : makeBenches();
+    for (auto && bench : benches) {
+        if (names) {
+            auto found = false;
+            for (auto && name : *names)
+                found = found || bench.name.compare(0, name.size(), name) == 0;
+            if (!found)
+                continue;
+        }
+        if (*list) {
+            cout << bench.name << '\n';
+            continue;
+        }
+        results.push_back(run(bench, *warmups, *reps));
+        if (text)
+            writeText(cout, results.back());
+    }
+
+    if (json && !*list) {
+        if (*json == "-") {
+            writeJson(cout, results, *warmups, *reps);
+        } else {
+            ofstream os(*json);
+            writeJson(os, results, *warmups, *reps);
+            if (!os) {
+                cerr << "Error: Unable to write to '" << *json << "'\n";
+                return Dim::kExitSoftware;
+            }
+        }
+    }
     return 0;
 }